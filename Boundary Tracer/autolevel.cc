@@ -0,0 +1,86 @@
+#include "statistics.hh"
+
+/** Stretches the red, green and blue components of `input` so that the
+ *  `clip` (0 to 0.5) darkest and brightest fractions of each one are
+ *  saturated and the remaining range covers all 256 levels. Alpha is kept.
+ *
+ *  Touches the pixels twice: once to gather statistics, once to remap. */
+void auto_level(const effect::BitmapView& input, const effect::BitmapView& output, double clip = 0.005){
+	statistics::summary stats = statistics::compute(input);
+
+	// Build the lookup table for each of the stretched components
+	u8 table[3][0x100];
+	for(size_t c = 0; c < 3; ++c){
+		size_t low  = stats[c].percentile(clip);
+		size_t high = stats[c].percentile(1 - clip);
+
+		for(size_t v = 0; v < 0x100; ++v){
+			if(high <= low)
+				table[c][v] = static_cast<u8>(v);
+			else if(v <= low)
+				table[c][v] = 0x00;
+			else if(v >= high)
+				table[c][v] = 0xFF;
+			else
+				table[c][v] = static_cast<u8>(((v - low) * 0xFF + (high - low) / 2) / (high - low));
+		}
+	}
+
+	#pragma omp parallel for schedule(static)
+	for(size_t y = 0; y < input.height; ++y){
+		const effect::Pixel<u8> *source = input.row(y);
+		effect::Pixel<u8>       *dest   = output.row(y);
+
+		for(size_t x = 0; x < input.width; ++x){
+			dest[x] = {
+				table[0][source[x].red],
+				table[1][source[x].green],
+				table[2][source[x].blue],
+				source[x].alpha
+			};
+		}
+	}
+}
+
+int main(int argc, char** argv){
+	struct{
+		std::string source = "";
+		std::string output = "";
+
+		bool incomplete() { return source.empty() || output.empty(); }
+
+		double clip = 0.005;
+	} flags;
+
+	for(size_t i = 1; i < argc; ++i){
+		// Parse flags
+		if((std::string(argv[i]) == "--clip" || std::string(argv[i]) == "-c") && i + 1 < argc)
+			flags.clip = std::min(0.5, std::max(0.0, atof(argv[++i]) / 100));
+		else{
+			// Parse default arguments
+			if(flags.source.empty())
+				flags.source = argv[i];
+			else if(flags.output.empty())
+				flags.output = argv[i];
+		}
+	}
+
+	if(flags.incomplete()){
+		fprintf(stderr, "Usage: %s [--clip <Percent>] <Input> <Output>\n", argv[0]);
+		return 3;
+	}
+
+	try{
+		// Load the texture into a bitmap
+		effect::Bitmap source = effect::load_bitmap(flags.source);
+
+		// Map the output file, effects are written straight into it
+		effect::Bitmap output = effect::map_bitmap(flags.output, source.width, source.height);
+
+		// Apply effects
+		auto_level(source, output, flags.clip);
+	}catch(const std::exception& e){
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+}
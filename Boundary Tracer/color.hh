@@ -0,0 +1,396 @@
+#ifndef __COLOR_H__
+#define __COLOR_H__
+
+#include "effect.hh"
+
+/** Conversions between RGB and other colour spaces.
+ *
+ *  Every space is a struct with four conversions:
+ *    - from_rgb() / to_rgb():   Fixed-point, with every component scaled to 0-255.
+ *    - from_rgbf() / to_rgbf(): Floating-point, in the space's natural ranges.
+ *
+ *  Alpha is carried over untouched. The per-pixel conversions are branch-light
+ *  inline functions, so the whole-bitmap convert() and revert() loops can be
+ *  vectorized by the compiler, and rows are spread across threads.
+ *
+ *  Floating-point round trips give back every colour exactly. Fixed-point ones
+ *  give it back within 4 levels per channel for HSV and HSL, 1 for YCbCr, and
+ *  for L*a*b* within a level of the worst that storing it in 8 bits allows.
+ *  colorcheck.cc checks every colour against these. */
+namespace color{
+	typedef effect::Pixel<u8>    pixel;
+	typedef effect::Pixel<float> pixelf;
+
+	/** @brief Clamps an integer to 0-255. */
+	inline u8 clamp(s32 value){
+		return static_cast<u8>(value < 0 ? 0 : (value > 0xFF ? 0xFF : value));
+	}
+
+	/** @brief Clamps and rounds a float to 0-255. */
+	inline u8 clampf(float value){
+		return static_cast<u8>(value <= 0 ? 0 : (value >= 0xFF ? 0xFF : value + 0.5f));
+	}
+
+	/** @brief Hue of a colour, in 1/1536ths of a turn, given its maximum and minimum components. */
+	inline s32 hue(s32 r, s32 g, s32 b, s32 max, s32 min){
+		s32 d = max - min;
+		if(d == 0)
+			return 0;
+
+		s32 h = max == r ? ((g - b) * 256) / d :
+		        max == g ? ((b - r) * 256) / d + 512 :
+		                   ((r - g) * 256) / d + 1024;
+
+		return h < 0 ? h + 1536 : h;
+	}
+
+	/** @brief Hue of a colour, in degrees, given its maximum and minimum components. */
+	inline float huef(float r, float g, float b, float max, float min){
+		float d = max - min;
+		if(d == 0)
+			return 0;
+
+		float h = max == r ? (g - b) / d :
+		          max == g ? (b - r) / d + 2 :
+		                     (r - g) / d + 4;
+
+		return h < 0 ? (h + 6) * 60 : h * 60;
+	}
+
+	/** @brief RGB colour of a hue, in 1/1536ths of a turn, at a chroma over a base level, both in 1/256ths. */
+	inline pixel sector(s32 h, s32 chroma, s32 base, u8 alpha){
+		s32 x = chroma * (256 - std::abs(h % 512 - 256)) / 256;
+
+		s32 r = h < 256 ? chroma : h < 512 ? x : h < 1024 ? 0 : h < 1280 ? x : chroma;
+		s32 g = h < 256 ? x : h < 768 ? chroma : h < 1024 ? x : 0;
+		s32 b = h < 512 ? 0 : h < 768 ? x : h < 1280 ? chroma : x;
+
+		return {clamp((r + base + 128) >> 8), clamp((g + base + 128) >> 8), clamp((b + base + 128) >> 8), alpha};
+	}
+
+	/** @brief RGB colour of a hue, in sixths of a turn, at a chroma over a base level, both from 0 to 1. */
+	inline pixel sectorf(float h, float chroma, float base, float alpha){
+		float x = chroma * (1 - std::fabs(std::fmod(h, 2.0f) - 1));
+
+		float r = h < 1 ? chroma : h < 2 ? x : h < 4 ? 0 : h < 5 ? x : chroma;
+		float g = h < 1 ? x : h < 3 ? chroma : h < 4 ? x : 0;
+		float b = h < 2 ? 0 : h < 3 ? x : h < 5 ? chroma : x;
+
+		return {clampf((r + base) * 0xFF), clampf((g + base) * 0xFF), clampf((b + base) * 0xFF), clampf(alpha)};
+	}
+
+	/** Hue, saturation and value. Hue is in degrees, or 256ths of a turn in fixed-point. */
+	struct hsv{
+		static pixel from_rgb(pixel p){
+			s32 max = std::max(p.red, std::max(p.green, p.blue));
+			s32 min = std::min(p.red, std::min(p.green, p.blue));
+
+			return {
+				static_cast<u8>(((hue(p.red, p.green, p.blue, max, min) + 3) / 6) & 0xFF),
+				static_cast<u8>(max == 0 ? 0 : ((max - min) * 0xFF + max / 2) / max),
+				static_cast<u8>(max),
+				p.alpha
+			};
+		}
+
+		static pixel to_rgb(pixel p){
+			s32 chroma = (p.blue * p.green * 256 + 127) / 0xFF;
+			return sector(p.red * 6, chroma, p.blue * 256 - chroma, p.alpha);
+		}
+
+		static pixelf from_rgbf(pixel p){
+			float r = p.red / 255.0f, g = p.green / 255.0f, b = p.blue / 255.0f;
+			float max = std::max(r, std::max(g, b));
+			float min = std::min(r, std::min(g, b));
+
+			return {huef(r, g, b, max, min), max == 0 ? 0 : (max - min) / max, max, static_cast<float>(p.alpha)};
+		}
+
+		static pixel to_rgbf(pixelf p){
+			float chroma = p.blue * p.green;
+			return sectorf(p.red / 60, chroma, p.blue - chroma, p.alpha);
+		}
+	};
+
+	/** Hue, saturation and lightness. Hue is in degrees, or 256ths of a turn in fixed-point. */
+	struct hsl{
+		static pixel from_rgb(pixel p){
+			s32 max = std::max(p.red, std::max(p.green, p.blue));
+			s32 min = std::min(p.red, std::min(p.green, p.blue));
+			s32 sum = max + min;
+
+			// Saturation is the chroma relative to the largest chroma possible at this lightness
+			s32 range = sum <= 0xFF ? sum : 510 - sum;
+
+			return {
+				static_cast<u8>(((hue(p.red, p.green, p.blue, max, min) + 3) / 6) & 0xFF),
+				static_cast<u8>(range == 0 ? 0 : ((max - min) * 0xFF + range / 2) / range),
+				static_cast<u8>((sum + 1) / 2),
+				p.alpha
+			};
+		}
+
+		static pixel to_rgb(pixel p){
+			s32 chroma = ((0xFF - std::abs(2 * p.blue - 0xFF)) * p.green * 256 + 127) / 0xFF;
+			return sector(p.red * 6, chroma, p.blue * 256 - chroma / 2, p.alpha);
+		}
+
+		static pixelf from_rgbf(pixel p){
+			float r = p.red / 255.0f, g = p.green / 255.0f, b = p.blue / 255.0f;
+			float max = std::max(r, std::max(g, b));
+			float min = std::min(r, std::min(g, b));
+			float l   = (max + min) / 2;
+
+			float range = 1 - std::fabs(2 * l - 1);
+			return {huef(r, g, b, max, min), range == 0 ? 0 : (max - min) / range, l, static_cast<float>(p.alpha)};
+		}
+
+		static pixel to_rgbf(pixelf p){
+			float chroma = (1 - std::fabs(2 * p.blue - 1)) * p.green;
+			return sectorf(p.red / 60, chroma, p.blue - chroma / 2, p.alpha);
+		}
+	};
+
+	/** Full-range ITU-R BT.601 luma and chroma, as used by JPEG. */
+	struct ycbcr{
+		// Coefficients are in 16.16 fixed-point
+		static const s32 half = 1 << 15;
+
+		static pixel from_rgb(pixel p){
+			s32 r = p.red, g = p.green, b = p.blue;
+			return {
+				clamp(( 19595 * r + 38470 * g +  7471 * b + half) >> 16),
+				clamp((-11059 * r - 21709 * g + 32768 * b + half + (128 << 16)) >> 16),
+				clamp(( 32768 * r - 27439 * g -  5329 * b + half + (128 << 16)) >> 16),
+				p.alpha
+			};
+		}
+
+		static pixel to_rgb(pixel p){
+			s32 y = p.red << 16, cb = p.green - 128, cr = p.blue - 128;
+			return {
+				clamp((y + 91881 * cr + half) >> 16),
+				clamp((y - 22554 * cb - 46802 * cr + half) >> 16),
+				clamp((y + 116130 * cb + half) >> 16),
+				p.alpha
+			};
+		}
+
+		static pixelf from_rgbf(pixel p){
+			float r = p.red, g = p.green, b = p.blue;
+			return {
+				 0.299f    * r + 0.587f    * g + 0.114f    * b,
+				-0.168736f * r - 0.331264f * g + 0.5f      * b + 128,
+				 0.5f      * r - 0.418688f * g - 0.081312f * b + 128,
+				static_cast<float>(p.alpha)
+			};
+		}
+
+		static pixel to_rgbf(pixelf p){
+			float cb = p.green - 128, cr = p.blue - 128;
+			return {
+				clampf(p.red + 1.402f * cr),
+				clampf(p.red - 0.344136f * cb - 0.714136f * cr),
+				clampf(p.red + 1.772f * cb),
+				clampf(p.alpha)
+			};
+		}
+	};
+
+	/** CIE L*a*b*, for sRGB under a D65 white point.
+	 *
+	 *  In fixed-point, L* is scaled from 0-100 to 0-255 and a* and b* are
+	 *  offset by 128. The transfer curves go through lookup tables built on
+	 *  first use, so no powers or cube roots are taken per pixel. */
+	struct lab{
+		// Resolution of the tables indexed by linear light
+		static const s32 linear_bits = 16;
+		static const s32 linear_one  = 1 << linear_bits;
+
+		struct tables{
+			s32 linear[0x100];         // sRGB value to linear light, in 1/linear_one
+			s32 f[linear_one + 1];     // Linear light to the L*a*b* companding function, in 1/65536
+			u8  srgb[linear_one + 1];  // Linear light back to the sRGB value
+
+			tables(){
+				for(s32 v = 0; v < 0x100; ++v)
+					linear[v] = static_cast<s32>(to_linear(v / 255.0f) * linear_one + 0.5f);
+
+				for(s32 t = 0; t <= linear_one; ++t){
+					f[t]    = static_cast<s32>(companding(static_cast<float>(t) / linear_one) * 65536 + 0.5f);
+					srgb[t] = clampf(from_linear(static_cast<float>(t) / linear_one) * 0xFF);
+				}
+			}
+		};
+
+		static const tables& table(){
+			static const tables t;
+			return t;
+		}
+
+		static float to_linear(float v){
+			return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+		}
+
+		static float from_linear(float v){
+			return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1 / 2.4f) - 0.055f;
+		}
+
+		static float companding(float t){
+			return t > 216.0f / 24389 ? std::cbrt(t) : (24389.0f / 27 * t + 16) / 116;
+		}
+
+		static float inverse_companding(float f){
+			return f > 6.0f / 29 ? f * f * f : (116 * f - 16) * 27 / 24389;
+		}
+
+		/** @brief Index into the linear light tables, clamped. */
+		static s32 index(s64 v){
+			return static_cast<s32>(v < 0 ? 0 : (v > linear_one ? linear_one : v));
+		}
+
+		static pixel from_rgb(pixel p){
+			const tables& t = table();
+			s32 r = t.linear[p.red], g = t.linear[p.green], b = t.linear[p.blue];
+
+			// RGB to XYZ, already divided by the white point, with 12 bit coefficients
+			s32 x = (1778 * r + 1541 * g +  777 * b + 2048) >> 12;
+			s32 y = ( 871 * r + 2929 * g +  296 * b + 2048) >> 12;
+			s32 z = (  73 * r +  448 * g + 3575 * b + 2048) >> 12;
+
+			s32 fx = t.f[index(x)], fy = t.f[index(y)], fz = t.f[index(z)];
+			return {
+				clamp(((116 * fy - 16 * 65536) * 255 / 100 + 32768) >> 16),
+				clamp(((500 * (fx - fy) + 32768) >> 16) + 128),
+				clamp(((200 * (fy - fz) + 32768) >> 16) + 128),
+				p.alpha
+			};
+		}
+
+		static pixel to_rgb(pixel p){
+			const tables& t = table();
+
+			float fy = (p.red * (100.0f / 255) + 16) / 116;
+			float fx = fy + (p.green - 128) / 500.0f;
+			float fz = fy - (p.blue  - 128) / 200.0f;
+
+			s64 x = static_cast<s64>(inverse_companding(fx) * linear_one + 0.5f);
+			s64 y = static_cast<s64>(inverse_companding(fy) * linear_one + 0.5f);
+			s64 z = static_cast<s64>(inverse_companding(fz) * linear_one + 0.5f);
+
+			// XYZ, relative to the white point, back to linear RGB. Colours
+			// outside of the sRGB gamut may overflow 32 bits along the way.
+			s64 r = (12616 * x - 6296 * y - 2224 * z + 2048) >> 12;
+			s64 g = (-3774 * x + 7684 * y +  186 * z + 2048) >> 12;
+			s64 b = (  217 * x -  836 * y + 4715 * z + 2048) >> 12;
+
+			return {t.srgb[index(r)], t.srgb[index(g)], t.srgb[index(b)], p.alpha};
+		}
+
+		static pixelf from_rgbf(pixel p){
+			float r = to_linear(p.red / 255.0f), g = to_linear(p.green / 255.0f), b = to_linear(p.blue / 255.0f);
+
+			float x = (0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f;
+			float y = (0.2126729f * r + 0.7151522f * g + 0.0721750f * b);
+			float z = (0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f;
+
+			float fx = companding(x), fy = companding(y), fz = companding(z);
+			return {116 * fy - 16, 500 * (fx - fy), 200 * (fy - fz), static_cast<float>(p.alpha)};
+		}
+
+		static pixel to_rgbf(pixelf p){
+			float fy = (p.red + 16) / 116;
+			float x = inverse_companding(fy + p.green / 500) * 0.95047f;
+			float y = inverse_companding(fy);
+			float z = inverse_companding(fy - p.blue / 200) * 1.08883f;
+
+			float r =  3.2404542f * x - 1.5371385f * y - 0.4985314f * z;
+			float g = -0.9692660f * x + 1.8760108f * y + 0.0415560f * z;
+			float b =  0.0556434f * x - 0.2040259f * y + 1.0572252f * z;
+
+			return {
+				clampf(from_linear(std::max(0.0f, r)) * 0xFF),
+				clampf(from_linear(std::max(0.0f, g)) * 0xFF),
+				clampf(from_linear(std::max(0.0f, b)) * 0xFF),
+				clampf(p.alpha)
+			};
+		}
+	};
+
+	/** @brief Converts every pixel of `input` from RGB to the fixed-point form of `Space`. */
+	template<typename Space>
+	void convert(const effect::BitmapView& input, const effect::BitmapView& output){
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < input.height; ++y){
+			const pixel *source = input.row(y);
+			pixel       *dest   = output.row(y);
+
+			#pragma omp simd
+			for(size_t x = 0; x < input.width; ++x)
+				dest[x] = Space::from_rgb(source[x]);
+		}
+	}
+
+	/** @brief Converts every pixel of `input` from RGB to the floating-point form of `Space`.
+	 *
+	 *  The floating-point pixels are stored in `output` without gaps between rows. */
+	template<typename Space>
+	void convert(const effect::BitmapView& input, pixelf* output){
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < input.height; ++y){
+			const pixel *source = input.row(y);
+			pixelf      *dest   = &output[y * input.width];
+
+			#pragma omp simd
+			for(size_t x = 0; x < input.width; ++x)
+				dest[x] = Space::from_rgbf(source[x]);
+		}
+	}
+
+	/** @brief Converts every pixel of `input` from the fixed-point form of `Space` back to RGB. */
+	template<typename Space>
+	void revert(const effect::BitmapView& input, const effect::BitmapView& output){
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < input.height; ++y){
+			const pixel *source = input.row(y);
+			pixel       *dest   = output.row(y);
+
+			#pragma omp simd
+			for(size_t x = 0; x < input.width; ++x)
+				dest[x] = Space::to_rgb(source[x]);
+		}
+	}
+
+	/** @brief Converts every pixel of `input`, stored without gaps between rows, from the floating-point form of `Space` back to RGB. */
+	template<typename Space>
+	void revert(const pixelf* input, const effect::BitmapView& output){
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < output.height; ++y){
+			const pixelf *source = &input[y * output.width];
+			pixel        *dest   = output.row(y);
+
+			#pragma omp simd
+			for(size_t x = 0; x < output.width; ++x)
+				dest[x] = Space::to_rgbf(source[x]);
+		}
+	}
+
+	/** @brief Difference between two fixed-point HSV colours, from 0 to 255.
+	 *
+	 *  Hue is compared around the colour wheel, so that reds on both ends of
+	 *  it are close, and weighted by the lower of both saturations, since the
+	 *  hue of a grey carries no information. The result is the largest of the
+	 *  hue, saturation and value differences. */
+	inline size_t difference(pixel a, pixel b){
+		s32 hue = std::abs(static_cast<s32>(a.red) - static_cast<s32>(b.red));
+		hue = std::min(hue, 0x100 - hue) * 2;
+		hue = (std::min<s32>(hue, 0xFF) * std::min(a.green, b.green)) / 0xFF;
+
+		return static_cast<size_t>(std::max<s32>(hue, std::max(
+			std::abs(static_cast<s32>(a.green) - static_cast<s32>(b.green)),
+			std::abs(static_cast<s32>(a.blue)  - static_cast<s32>(b.blue))
+		)));
+	}
+}
+
+#endif // __COLOR_H__
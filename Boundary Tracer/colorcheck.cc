@@ -0,0 +1,119 @@
+#include "color.hh"
+
+#include <algorithm> // For std::max() and std::min()
+#include <cmath>     // For std::round()
+#include <cstdio>    // For printf() and fprintf()
+#include <cstdlib>   // For abs()
+#include <vector>    // For std::vector
+
+/** Checks that every colour space of color.hh gives back every one of the
+ *  2^24 RGB colours, through the whole-bitmap conversions, within the
+ *  tolerances color.hh states: exactly through floating-point, and within a
+ *  few levels through fixed-point. Alpha must always come back untouched.
+ *  Built like the tracer, from colorcheck.cc and glt/glt.cc, with OpenMP.
+ *  Prints the largest error of every conversion, and exits with 1 if any
+ *  is over its tolerance. */
+
+// Colours are checked a band of 256 rows of 4096 of them at a time
+static const size_t band_width  = 4096;
+static const size_t band_height = 256;
+static const size_t bands       = (1 << 24) / (band_width * band_height);
+
+/** @brief Fills `band` with the colours of band `b`, alpha varying along with them. */
+void fill(const effect::BitmapView& band, size_t b){
+	for(size_t y = 0; y < band.height; ++y){
+		color::pixel *row = band.row(y);
+
+		for(size_t x = 0; x < band.width; ++x){
+			u32 c = static_cast<u32>((b * band.height + y) * band.width + x);
+			row[x] = { static_cast<u8>(c >> 16), static_cast<u8>(c >> 8), static_cast<u8>(c), static_cast<u8>(c * 7) };
+		}
+	}
+}
+
+/** @brief Largest difference between the colour channels of `a` and `b`, or 256 if their alpha differs. */
+int error(const effect::BitmapView& a, const effect::BitmapView& b){
+	int worst = 0;
+	for(size_t y = 0; y < a.height; ++y){
+		const color::pixel *p = a.row(y), *q = b.row(y);
+
+		for(size_t x = 0; x < a.width; ++x){
+			if(p[x].alpha != q[x].alpha)
+				return 0x100;
+
+			worst = std::max(worst, std::max(abs(p[x].red - q[x].red), std::max(abs(p[x].green - q[x].green), abs(p[x].blue - q[x].blue))));
+		}
+	}
+
+	return worst;
+}
+
+/** @brief Largest error of a round trip of every colour through `Space`, in fixed-point and in floating-point. */
+template<typename Space>
+void round_trip(int& fixed, int& floating){
+	effect::Bitmap original(band_width, band_height), converted(band_width, band_height), back(band_width, band_height);
+	std::vector<color::pixelf> exact(band_width * band_height);
+
+	fixed = floating = 0;
+	for(size_t b = 0; b < bands; ++b){
+		fill(original.view(), b);
+
+		color::convert<Space>(original.view(), converted.view());
+		color::revert<Space>(converted.view(), back.view());
+		fixed = std::max(fixed, error(original.view(), back.view()));
+
+		color::convert<Space>(original.view(), exact.data());
+		color::revert<Space>(exact.data(), back.view());
+		floating = std::max(floating, error(original.view(), back.view()));
+	}
+}
+
+/** @brief Largest error of any colour whose exact L*a*b* is rounded to 8 bits, as the fixed-point form stores it, then turned back exactly. */
+int lab_quantization(){
+	int worst = 0;
+	for(u32 c = 0; c < (1u << 24); ++c){
+		color::pixel  p = { static_cast<u8>(c >> 16), static_cast<u8>(c >> 8), static_cast<u8>(c), 0 };
+		color::pixelf l = color::lab::from_rgbf(p);
+
+		l.red   = std::round(l.red * 255 / 100) * 100 / 255;
+		l.green = std::round(std::min(127.0f, std::max(-128.0f, l.green)));
+		l.blue  = std::round(std::min(127.0f, std::max(-128.0f, l.blue)));
+
+		color::pixel q = color::lab::to_rgbf(l);
+		worst = std::max(worst, std::max(abs(p.red - q.red), std::max(abs(p.green - q.green), abs(p.blue - q.blue))));
+	}
+
+	return worst;
+}
+
+int main(){
+	size_t failed = 0;
+
+	auto check = [&](const char* name, const char* form, int error, int tolerance){
+		printf("%-5s %-14s within %3d levels, of %d\n", name, form, error, tolerance);
+		if(error > tolerance){
+			fprintf(stderr, "%s does not come back within %d levels through %s\n", name, tolerance, form);
+			++failed;
+		}
+	};
+
+	int fixed, floating;
+
+	round_trip<color::hsv>(fixed, floating);
+	check("HSV", "fixed-point", fixed, 4);
+	check("HSV", "floating-point", floating, 0);
+
+	round_trip<color::hsl>(fixed, floating);
+	check("HSL", "fixed-point", fixed, 4);
+	check("HSL", "floating-point", floating, 0);
+
+	round_trip<color::ycbcr>(fixed, floating);
+	check("YCbCr", "fixed-point", fixed, 1);
+	check("YCbCr", "floating-point", floating, 0);
+
+	round_trip<color::lab>(fixed, floating);
+	check("Lab", "fixed-point", fixed, lab_quantization() + 1);
+	check("Lab", "floating-point", floating, 0);
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+#ifndef __CONTOURS_H__
+#define __CONTOURS_H__
+
+#include "effect.hh"
+
+#include <vector>    // For std::vector
+#include <stdexcept> // For std::length_error
+
+/** Connected regions of a binary mask, and the outlines around them. */
+namespace contours{
+	/** Index of a pixel, or of a point of a contour, none if all bits are set. */
+	typedef u32 index;
+	static const index none = 0xFFFFFFFF;
+
+	/** Rows of the mask are labelled in bands of this many, in parallel. */
+	static const size_t band = 64;
+
+	/** @brief Root of the tree `i` is in, halving the path to it on the way. */
+	index find(index* parent, index i){
+		while(parent[i] != i){
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+
+		return i;
+	}
+
+	/** @brief Joins the trees of `a` and `b`, under whichever root comes first. */
+	void join(index* parent, index a, index b){
+		a = find(parent, a);
+		b = find(parent, b);
+
+		if(a < b)
+			parent[b] = a;
+		else if(b < a)
+			parent[a] = b;
+	}
+
+	/** @brief Labels the 8-connected regions of non-zero pixels in `mask`, returning how many there are.
+	 *
+	 *  Labels start at 1 and are given in the order the regions' first pixels
+	 *  show up in, row by row, 0 being left for the background. Every band of
+	 *  rows is labelled on its own, in parallel, touching only the union-find
+	 *  trees of its own pixels. Bands are then merged across their edges, and
+	 *  the roots numbered, so the labels are the same for any number of
+	 *  threads. */
+	size_t label(const u8* mask, size_t width, size_t height, index* labels){
+		if(width * height >= none)
+			throw std::length_error("Image too large to be labelled.");
+
+		const size_t bands = (height + band - 1) / band;
+
+		std::vector<index> parent(width * height);
+
+		#pragma omp parallel for schedule(dynamic)
+		for(size_t b = 0; b < bands; ++b){
+			size_t y0 = b * band, y1 = std::min(height, y0 + band);
+
+			for(size_t y = y0; y < y1; ++y){
+				for(size_t x = 0; x < width; ++x){
+					index i = y * width + x;
+					parent[i] = i;
+
+					if(!mask[i])
+						continue;
+
+					if(x > 0 && mask[i - 1])
+						join(parent.data(), i, i - 1);
+
+					if(y == y0)
+						continue;
+
+					for(size_t nx = x == 0 ? x : x - 1; nx <= x + 1 && nx < width; ++nx)
+						if(mask[(y - 1) * width + nx])
+							join(parent.data(), i, (y - 1) * width + nx);
+				}
+			}
+		}
+
+		// Merge the bands across their edges
+		for(size_t b = 1; b < bands; ++b){
+			size_t y = b * band;
+
+			for(size_t x = 0; x < width; ++x){
+				if(!mask[y * width + x])
+					continue;
+
+				for(size_t nx = x == 0 ? x : x - 1; nx <= x + 1 && nx < width; ++nx)
+					if(mask[(y - 1) * width + nx])
+						join(parent.data(), y * width + x, (y - 1) * width + nx);
+			}
+		}
+
+		// Number the roots, counting those of every band first
+		std::vector<size_t> first(bands + 1, 0);
+
+		#pragma omp parallel for schedule(dynamic)
+		for(size_t b = 0; b < bands; ++b){
+			size_t roots = 0;
+			for(size_t i = b * band * width; i < std::min(height, (b + 1) * band) * width; ++i)
+				roots += mask[i] && parent[i] == i;
+
+			first[b + 1] = roots;
+		}
+
+		for(size_t b = 0; b < bands; ++b)
+			first[b + 1] += first[b];
+
+		#pragma omp parallel for schedule(dynamic)
+		for(size_t b = 0; b < bands; ++b){
+			index next = first[b] + 1;
+			for(size_t i = b * band * width; i < std::min(height, (b + 1) * band) * width; ++i)
+				labels[i] = mask[i] && parent[i] == i ? next++ : 0;
+		}
+
+		// Then give every pixel the number of its root, which is never after it
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < height; ++y){
+			for(size_t x = 0; x < width; ++x){
+				index i = y * width + x;
+				if(!mask[i] || parent[i] == i)
+					continue;
+
+				index root = i;
+				while(parent[root] != root)
+					root = parent[root];
+
+				labels[i] = labels[root];
+			}
+		}
+
+		return first[bands];
+	}
+
+	/** A closed outline, as the points it turns at. */
+	struct polyline{
+		index label;
+
+		// In halves of a pixel, as points lie between pixel centres
+		std::vector<s64> points;
+	};
+
+	/** @brief Outlines the regions of non-zero pixels in `mask` with marching squares.
+	 *
+	 *  Points of the outlines lie halfway between the centres of a pixel in a
+	 *  region and one outside of it, with the image surrounded by pixels
+	 *  outside of every region. Regions touching at a corner are outlined as
+	 *  one, as they are labelled. Every outline comes with the label, in
+	 *  `labels`, of the region it goes around, or of the one it is a hole of.
+	 *
+	 *  Squares work out which point follows each of their points in parallel,
+	 *  as each point is left from a single square. Outlines are then followed
+	 *  from their first point, keeping only the points they turn at. */
+	std::vector<polyline> outline(const u8* mask, const index* labels, size_t width, size_t height){
+		// Corners of the squares, padded by one pixel all around
+		const size_t cw = width + 2, ch = height + 2;
+
+		// Points on the horizontal edges come first, then those on the vertical ones
+		const size_t horizontal = (cw - 1) * ch;
+		const size_t points     = horizontal + cw * (ch - 1);
+
+		if(points >= none)
+			throw std::length_error("Image too large to be outlined.");
+
+		#define CORNER(X, Y) ((X) > 0 && (Y) > 0 && (X) <= width && (Y) <= height && mask[((Y) - 1) * width + (X) - 1])
+		#define ACROSS(X, Y) static_cast<index>((Y) * (cw - 1) + (X))
+		#define DOWN(X, Y)   static_cast<index>(horizontal + (Y) * cw + (X))
+
+		std::vector<index> next(points, none);
+
+		#pragma omp parallel for schedule(static)
+		for(size_t Y = 0; Y < ch - 1; ++Y){
+			for(size_t X = 0; X < cw - 1; ++X){
+				// Corners and edges clockwise, edge k going from corner k to the next one
+				bool  corner[4] = { CORNER(X, Y), CORNER(X + 1, Y), CORNER(X + 1, Y + 1), CORNER(X, Y + 1) };
+				index edge[4]   = { ACROSS(X, Y), DOWN(X + 1, Y),   ACROSS(X, Y + 1),     DOWN(X, Y)        };
+
+				if(corner[0] == corner[1] && corner[1] == corner[2] && corner[2] == corner[3])
+					continue;
+
+				// Leaving the region, join the point where it is next entered. Around
+				// a saddle, this cuts the outside corners off, joining the diagonal.
+				for(size_t k = 0; k < 4; ++k){
+					if(!corner[k] || corner[(k + 1) % 4])
+						continue;
+
+					size_t e = (k + 1) % 4;
+					while(corner[e] || !corner[(e + 1) % 4])
+						e = (e + 1) % 4;
+
+					next[edge[k]] = edge[e];
+				}
+			}
+		}
+
+		std::vector<polyline> result;
+		std::vector<u8>       seen(points, 0);
+
+		for(index start = 0; start < points; ++start){
+			if(next[start] == none || seen[start])
+				continue;
+
+			polyline line;
+
+			// Label of the pixel in a region the first point is next to
+			size_t X, Y, ax, ay, bx, by;
+			if(start < horizontal){
+				X = start % (cw - 1); Y = start / (cw - 1);
+				ax = X; ay = Y; bx = X + 1; by = Y;
+			}else{
+				X = (start - horizontal) % cw; Y = (start - horizontal) / cw;
+				ax = X; ay = Y; bx = X; by = Y + 1;
+			}
+
+			if(CORNER(ax, ay))
+				line.label = labels[(ay - 1) * width + ax - 1];
+			else
+				line.label = labels[(by - 1) * width + bx - 1];
+
+			// Follow it around, dropping points along straight runs
+			s64 dx = 0, dy = 0;
+			index p = start;
+			do{
+				seen[p] = 1;
+
+				s64 x, y;
+				if(p < horizontal){
+					x = 2 * static_cast<s64>(p % (cw - 1)) - 1;
+					y = 2 * static_cast<s64>(p / (cw - 1)) - 2;
+				}else{
+					x = 2 * static_cast<s64>((p - horizontal) % cw) - 2;
+					y = 2 * static_cast<s64>((p - horizontal) / cw) - 1;
+				}
+
+				size_t n = line.points.size();
+				if(n >= 4){
+					s64 px = line.points[n - 2], py = line.points[n - 1];
+					if((x - px) * dy == (y - py) * dx){
+						// Same direction, move the last point forward instead
+						line.points[n - 2] = x;
+						line.points[n - 1] = y;
+						p = next[p];
+						continue;
+					}
+				}
+
+				if(n >= 2){
+					dx = x - line.points[n - 2];
+					dy = y - line.points[n - 1];
+				}
+
+				line.points.push_back(x);
+				line.points.push_back(y);
+
+				p = next[p];
+			}while(p != start && p != none);
+
+			result.push_back(std::move(line));
+		}
+
+		#undef CORNER
+		#undef ACROSS
+		#undef DOWN
+
+		return result;
+	}
+
+	/** @brief Writes outlines as text, a line per outline.
+	 *
+	 *  The first line is "contours <width> <height> <regions> <outlines>", every
+	 *  other one "<label> <points> <x> <y> ...", coordinates in pixels, from the
+	 *  centre of the top-left one. Throws std::runtime_error if the file cannot
+	 *  be created. */
+	void write(const std::vector<polyline>& lines, size_t width, size_t height, size_t regions, const std::string& output){
+		FILE *file = fopen(output.c_str(), "w");
+		if(file == NULL)
+			throw std::runtime_error("Could not open output file.");
+
+		fprintf(file, "contours %zu %zu %zu %zu\n", width, height, regions, lines.size());
+
+		for(const polyline& line : lines){
+			fprintf(file, "%u %zu", line.label, line.points.size() / 2);
+
+			// Halves of a pixel, without going through floats
+			for(s64 v : line.points){
+				if(v % 2 == 0)
+					fprintf(file, " %lld", (long long) (v / 2));
+				else
+					fprintf(file, " %s%lld.5", v < 0 ? "-" : "", (long long) (std::abs(v) / 2));
+			}
+
+			fputc('\n', file);
+		}
+
+		fclose(file);
+	}
+}
+
+#endif // __CONTOURS_H__
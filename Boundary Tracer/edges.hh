@@ -0,0 +1,325 @@
+#ifndef __EDGES_H__
+#define __EDGES_H__
+
+#include "effect.hh"
+
+#include <vector> // For std::vector
+
+/** Classic edge operators, working on the luma of an image.
+ *
+ *  Gradients are separable 3x3 kernels in 16-bit integers, a smoothing pass
+ *  across the derivative one, so both passes run as plain loops over rows
+ *  the compiler can vectorize. Pixels outside of the image repeat the ones
+ *  at its edges. */
+namespace edges{
+	enum kind{
+		sobel,  // Smoothing of 1 2 1
+		scharr, // Smoothing of 3 10 3
+		canny   // Sobel, thinned by non-maximum suppression and hysteresis
+	};
+
+	/** @brief Computes the luma of every pixel in `input`, as color::ycbcr does. */
+	void luma(const effect::BitmapView& input, u8* plane){
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < input.height; ++y){
+			const effect::Pixel<u8> *row  = input.row(y);
+			u8                      *dest = &plane[y * input.width];
+
+			#pragma omp simd
+			for(size_t x = 0; x < input.width; ++x)
+				dest[x] = static_cast<u8>((19595 * row[x].red + 38470 * row[x].green + 7471 * row[x].blue + (1 << 15)) >> 16);
+		}
+	}
+
+	/** @brief Horizontal and vertical gradients of a row, given the rows around it.
+	 *
+	 *  `smooth` and `delta` are scratch rows, `width` long. */
+	template<s16 side, s16 centre>
+	void gradient_row(const u8* above, const u8* here, const u8* below, size_t width,
+	                  s16* smooth, s16* delta, s16* gx, s16* gy){
+		// Down the columns
+		#pragma omp simd
+		for(size_t x = 0; x < width; ++x){
+			smooth[x] = side * above[x] + centre * here[x] + side * below[x];
+			delta[x]  = below[x] - above[x];
+		}
+
+		// Then across them
+		const size_t last = width < 2 ? 1 : width - 1;
+
+		#pragma omp simd
+		for(size_t x = 1; x < last; ++x){
+			gx[x] = smooth[x + 1] - smooth[x - 1];
+			gy[x] = side * delta[x - 1] + centre * delta[x] + side * delta[x + 1];
+		}
+
+		// Edges, repeating the outermost columns
+		size_t ends[2] = { 0, width - 1 };
+		for(size_t i = 0; i < (width > 1 ? 2 : 1); ++i){
+			size_t x     = ends[i];
+			size_t left  = x == 0         ? x : x - 1;
+			size_t right = x == width - 1 ? x : x + 1;
+
+			gx[x] = smooth[right] - smooth[left];
+			gy[x] = side * delta[left] + centre * delta[x] + side * delta[right];
+		}
+	}
+
+	/** @brief Calls visit(y, gx, gy) with the gradients of every row of a luma plane.
+	 *
+	 *  Rows are split between threads, each one with its own scratch rows, so
+	 *  `visit` may be called concurrently, for different rows. */
+	template<s16 side, s16 centre, typename Visitor>
+	void gradients(const u8* plane, size_t width, size_t height, Visitor visit){
+		#pragma omp parallel
+		{
+			std::vector<s16> scratch(width * 4);
+
+			s16 *smooth = &scratch[0];
+			s16 *delta  = &scratch[width];
+			s16 *gx     = &scratch[width * 2];
+			s16 *gy     = &scratch[width * 3];
+
+			#pragma omp for schedule(static)
+			for(size_t y = 0; y < height; ++y){
+				size_t above = y == 0          ? y : y - 1;
+				size_t below = y == height - 1 ? y : y + 1;
+
+				gradient_row<side, centre>(&plane[above * width], &plane[y * width], &plane[below * width],
+				                           width, smooth, delta, gx, gy);
+				visit(y, gx, gy);
+			}
+		}
+	}
+
+	/** @brief Writes the gradient magnitude of every row, |gx| + |gy|, scaled down to a byte. */
+	template<s16 side, s16 centre>
+	void magnitude(const u8* plane, size_t width, size_t height, u8* strength){
+		// Highest magnitude is 2 * (side * 2 + centre) * 0xFF, shift it into 0xFF
+		const s32 shift = side + side + centre == 4 ? 3 : 5;
+
+		gradients<side, centre>(plane, width, height, [&](size_t y, const s16* gx, const s16* gy){
+			u8 *dest = &strength[y * width];
+
+			#pragma omp simd
+			for(size_t x = 0; x < width; ++x){
+				s32 m = std::abs(static_cast<s32>(gx[x])) + std::abs(static_cast<s32>(gy[x]));
+				dest[x] = static_cast<u8>(std::min<s32>(0xFF, (m + (1 << (shift - 1))) >> shift));
+			}
+		});
+	}
+
+	/** @brief Direction of a gradient, rounded to one of four, numbered as the neighbours it points to. */
+	enum direction{ across, diagonal_down, down, diagonal_up };
+
+	/** @brief Walks the weak pixels (0x01) connected to the strong ones (0xFF) in
+	 *  `stack`, making them strong, without leaving rows [y0, y1). */
+	void follow(u8* marks, size_t width, size_t y0, size_t y1, std::vector<size_t>& stack){
+		while(!stack.empty()){
+			size_t i = stack.back();
+			stack.pop_back();
+
+			size_t x = i % width;
+			size_t y = i / width;
+
+			for(size_t ny = y == y0 ? y : y - 1; ny <= y + 1 && ny < y1; ++ny){
+				for(size_t nx = x == 0 ? x : x - 1; nx <= x + 1 && nx < width; ++nx){
+					size_t n = ny * width + nx;
+					if(marks[n] != 0x01)
+						continue;
+
+					marks[n] = 0xFF;
+					stack.push_back(n);
+				}
+			}
+		}
+	}
+
+	/** @brief Keeps the weak pixels (0x01) connected to a strong one (0xFF), clearing the others.
+	 *
+	 *  The image is cut into bands of rows that are followed in parallel, each
+	 *  only writing its own rows. Edges crossing into another band are picked
+	 *  up by the next round, from the rows around the band, which are only read
+	 *  while no band is being written. Rounds go on until none of them grows,
+	 *  and the result is the same however the bands are scheduled. */
+	void hysteresis(u8* marks, size_t width, size_t height){
+		const size_t band  = 64;
+		const size_t bands = (height + band - 1) / band;
+
+		std::vector<std::vector<size_t>> seeds(bands);
+
+		// Start from the strong pixels
+		#pragma omp parallel for schedule(dynamic)
+		for(size_t b = 0; b < bands; ++b){
+			size_t y0 = b * band, y1 = std::min(height, y0 + band);
+
+			std::vector<size_t> stack;
+			for(size_t i = y0 * width; i < y1 * width; ++i)
+				if(marks[i] == 0xFF)
+					stack.push_back(i);
+
+			follow(marks, width, y0, y1, stack);
+		}
+
+		bool grown = bands > 1;
+		while(grown){
+			grown = false;
+
+			// Find the weak pixels touching a strong one across a band's edges
+			#pragma omp parallel for schedule(dynamic)
+			for(size_t b = 0; b < bands; ++b){
+				size_t y0 = b * band, y1 = std::min(height, y0 + band);
+
+				seeds[b].clear();
+				for(size_t e = 0; e < 2; ++e){
+					// Row of this band, and the one just outside of it
+					size_t y, outside;
+					if(e == 0){
+						if(y0 == 0) continue;
+						y = y0; outside = y0 - 1;
+					}else{
+						if(y1 == height) continue;
+						y = y1 - 1; outside = y1;
+					}
+
+					for(size_t x = 0; x < width; ++x){
+						if(marks[y * width + x] != 0x01)
+							continue;
+
+						for(size_t nx = x == 0 ? x : x - 1; nx <= x + 1 && nx < width; ++nx){
+							if(marks[outside * width + nx] == 0xFF){
+								seeds[b].push_back(y * width + x);
+								break;
+							}
+						}
+					}
+				}
+			}
+
+			// Then follow them, within the band
+			#pragma omp parallel for schedule(dynamic) reduction(||:grown)
+			for(size_t b = 0; b < bands; ++b){
+				size_t y0 = b * band, y1 = std::min(height, y0 + band);
+
+				std::vector<size_t> stack;
+				for(size_t i : seeds[b]){
+					if(marks[i] != 0x01)
+						continue;
+
+					marks[i] = 0xFF;
+					stack.push_back(i);
+				}
+
+				grown = grown || !stack.empty();
+				follow(marks, width, y0, y1, stack);
+			}
+		}
+
+		// Drop what was never reached
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < height; ++y)
+			for(size_t x = 0; x < width; ++x)
+				if(marks[y * width + x] != 0xFF)
+					marks[y * width + x] = 0x00;
+	}
+
+	/** @brief Marks the edges of a luma plane with 0xFF, as found by the Canny detector.
+	 *
+	 *  `low` and `high` are the hysteresis thresholds, as fractions of the
+	 *  highest magnitude left after non-maximum suppression. */
+	void canny_edges(const u8* plane, size_t width, size_t height, u8* strength, double low, double high){
+		std::vector<u16> magnitudes(width * height);
+		std::vector<u8>  directions(width * height);
+
+		// tan(22.5) and tan(67.5), in 8.8 fixed-point
+		const s32 shallow = 106, steep = 618;
+
+		gradients<1, 2>(plane, width, height, [&](size_t y, const s16* gx, const s16* gy){
+			u16 *m = &magnitudes[y * width];
+			u8  *d = &directions[y * width];
+
+			#pragma omp simd
+			for(size_t x = 0; x < width; ++x){
+				s32 ax = std::abs(static_cast<s32>(gx[x]));
+				s32 ay = std::abs(static_cast<s32>(gy[x]));
+
+				m[x] = static_cast<u16>(ax + ay);
+				d[x] = ay * 256 <= ax * shallow ? across
+				     : ay * 256 >= ax * steep   ? down
+				     : (gx[x] < 0) == (gy[x] < 0) ? diagonal_down : diagonal_up;
+			}
+		});
+
+		// Thin edges down to their ridges, neighbours outside of the image count as none
+		std::vector<u16> thin(width * height);
+		u16 highest = 0;
+
+		#pragma omp parallel for schedule(static) reduction(max:highest)
+		for(size_t y = 0; y < height; ++y){
+			for(size_t x = 0; x < width; ++x){
+				static const s32 steps[4][2] = { { 1, 0 }, { 1, 1 }, { 0, 1 }, { 1, -1 } };
+				const s32 *step = steps[directions[y * width + x]];
+
+				u16 m = magnitudes[y * width + x];
+				u16 sides[2] = { 0, 0 };
+
+				for(size_t s = 0; s < 2; ++s){
+					s64 nx = static_cast<s64>(x) + (s == 0 ? step[0] : -step[0]);
+					s64 ny = static_cast<s64>(y) + (s == 0 ? step[1] : -step[1]);
+
+					if(nx >= 0 && ny >= 0 && nx < static_cast<s64>(width) && ny < static_cast<s64>(height))
+						sides[s] = magnitudes[ny * width + nx];
+				}
+
+				// Ties go to the first of a plateau, so it is not left two pixels wide
+				u16 kept = m > sides[0] && m >= sides[1] ? m : 0;
+
+				thin[y * width + x] = kept;
+				highest = std::max(highest, kept);
+			}
+		}
+
+		u16 strong = static_cast<u16>(std::max(1.0, std::ceil(high * highest)));
+		u16 weak   = static_cast<u16>(std::max(1.0, std::ceil(std::min(low, high) * highest)));
+
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < height; ++y){
+			#pragma omp simd
+			for(size_t x = 0; x < width; ++x){
+				u16 m = thin[y * width + x];
+				strength[y * width + x] = m >= strong ? 0xFF : m >= weak ? 0x01 : 0x00;
+			}
+		}
+
+		hysteresis(strength, width, height);
+	}
+
+	/** Measures the edges of an image with one of the operators above. */
+	struct detector{
+		kind type = sobel;
+
+		// Canny's hysteresis thresholds
+		double low  = 0.1;
+		double high = 0.3;
+
+		/** @brief Writes how strong an edge every pixel of `input` is on, into `strength`. */
+		void operator()(const effect::BitmapView& input, u8* strength) const{
+			std::vector<u8> plane(input.width * input.height);
+			luma(input, plane.data());
+
+			switch(type){
+				case sobel:
+					magnitude<1, 2>(plane.data(), input.width, input.height, strength);
+					break;
+				case scharr:
+					magnitude<3, 10>(plane.data(), input.width, input.height, strength);
+					break;
+				case canny:
+					canny_edges(plane.data(), input.width, input.height, strength, low, high);
+					break;
+			}
+		}
+	};
+}
+
+#endif // __EDGES_H__
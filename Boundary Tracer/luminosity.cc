@@ -1,26 +1,27 @@
 #include "effect.hh"
 
-int main(int /*argc*/, char** argv){
-	// Load the texture into a buffer
-	glt::file sourcef(argv[1]);
-	
-	// Create a bitmap representing that texture
-	effect::Bitmap source;
-	source.width  = sourcef.get_texture_header().width;
-	source.height = sourcef.get_texture_header().height;
-	source.data   = (effect::Pixel<u8>*) sourcef.get_texture_data();
-	
-	// Apply effects
-	for(size_t x = 0; x < source.width; ++x){
-		for(size_t y = 0; y < source.height; ++y){
-			effect::Pixel<u8> *current = &source.data[y * source.width + x];
-			
-			effect::hsv data(current);
+void luminosity(const effect::BitmapView& input, const effect::BitmapView& output){
+	for(size_t y = 0; y < input.height; ++y){
+		for(size_t x = 0; x < input.width; ++x){
+			effect::hsv data(input.at(x, y));
 			
-			*current = {static_cast<u8>(data.luminosity), static_cast<u8>(data.luminosity), static_cast<u8>(data.luminosity)};
+			*output.at(x, y) = {static_cast<u8>(data.luminosity), static_cast<u8>(data.luminosity), static_cast<u8>(data.luminosity)};
 		}
 	}
-	
-	// Write file
-	write_bitmap(&source, std::string(argv[2]));
+}
+
+int main(int /*argc*/, char** argv){
+	try{
+		// Load the texture into a bitmap
+		effect::Bitmap source = effect::load_bitmap(argv[1]);
+		
+		// Map the output file, effects are written straight into it
+		effect::Bitmap output = effect::map_bitmap(argv[2], source.width, source.height);
+		
+		// Apply effects
+		luminosity(source, output);
+	}catch(const std::exception& e){
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
 }
@@ -0,0 +1,73 @@
+#include "masks.hh"
+
+/** Post-processing of the 1-bit masks the tracer writes with --edges 1, a
+ *  whole word of pixels at a time. */
+int main(int argc, char** argv){
+	struct{
+		std::string              operation = "";
+		std::vector<std::string> files;
+
+		bool incomplete(){
+			if(operation == "count")
+				return files.size() < 1;
+			if(operation == "dilate")
+				return files.size() < 2;
+			if(operation == "and" || operation == "or" || operation == "xor")
+				return files.size() < 3;
+
+			return true;
+		}
+
+		size_t times = 1;
+	} flags;
+
+	for(size_t i = 1; i < argc; ++i){
+		// Parse flags
+		if((std::string(argv[i]) == "--times" || std::string(argv[i]) == "-t") && i + 1 < argc)
+			flags.times = atoi(argv[++i]);
+		else{
+			// Parse default arguments
+			if(flags.operation.empty())
+				flags.operation = argv[i];
+			else
+				flags.files.push_back(argv[i]);
+		}
+	}
+
+	if(flags.incomplete()){
+		fprintf(stderr, "Usage: %s <and|or|xor> <A> <B> <Output>\n", argv[0]);
+		fprintf(stderr, "       %s dilate [--times <Pixels>] <Input> <Output>\n", argv[0]);
+		fprintf(stderr, "       %s count <Input>\n", argv[0]);
+		return 3;
+	}
+
+	try{
+		masks::mask a = masks::load(flags.files[0]);
+
+		if(flags.operation == "count"){
+			printf("Pixels: %zu of %zu\n", masks::count(a), a.width * a.height);
+			return 0;
+		}
+
+		if(flags.operation == "dilate"){
+			masks::save(masks::dilate(a, flags.times), flags.files[1]);
+			return 0;
+		}
+
+		masks::mask b = masks::load(flags.files[1]);
+		if(a.width != b.width || a.height != b.height){
+			fprintf(stderr, "Masks are not the same size.\n");
+			return 3;
+		}
+
+		if(flags.operation == "and")
+			masks::save(masks::intersect(a, b), flags.files[2]);
+		else if(flags.operation == "or")
+			masks::save(masks::unite(a, b), flags.files[2]);
+		else
+			masks::save(masks::exclude(a, b), flags.files[2]);
+	}catch(const std::exception& e){
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+}
@@ -0,0 +1,248 @@
+#ifndef __MASKS_H__
+#define __MASKS_H__
+
+#include "effect.hh"
+
+#include <vector> // For std::vector
+
+/** Binary masks, packed a bit per pixel into 64-bit words.
+ *
+ *  Pixel x of a row lives in bit x % 64 of its word x / 64, the same order
+ *  R1 textures pack them in, a byte at a time. Bits past the width of the
+ *  mask are always left clear, so whole words can be worked on at once,
+ *  without looking at where rows end. */
+namespace masks{
+	typedef u64 word;
+	static const size_t bits = 64;
+
+	struct mask{
+		size_t width  = 0;
+		size_t height = 0;
+		size_t words  = 0; // Per row
+
+		std::vector<word> data;
+
+		mask() { }
+
+		mask(size_t width, size_t height){
+			this->width  = width;
+			this->height = height;
+			this->words  = (width + bits - 1) / bits;
+
+			data.assign(words * height, 0);
+		}
+
+		word* row(size_t y){
+			return &data[y * words];
+		}
+
+		const word* row(size_t y) const{
+			return &data[y * words];
+		}
+
+		bool get(size_t x, size_t y) const{
+			return (row(y)[x / bits] >> (x % bits)) & 1;
+		}
+
+		void set(size_t x, size_t y, bool value = true){
+			word bit = static_cast<word>(1) << (x % bits);
+
+			if(value)
+				row(y)[x / bits] |= bit;
+			else
+				row(y)[x / bits] &= ~bit;
+		}
+
+		/** @brief Bits of the last word of a row that lie within the mask. */
+		word tail() const{
+			return width % bits == 0 ? ~static_cast<word>(0) : (static_cast<word>(1) << (width % bits)) - 1;
+		}
+	};
+
+	/** @brief Masks the values of a width x height plane that are at least `level`. */
+	mask pack(const u8* values, size_t width, size_t height, u8 level){
+		mask result(width, height);
+
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < height; ++y){
+			const u8 *source = &values[y * width];
+			word     *dest   = result.row(y);
+
+			for(size_t i = 0; i < result.words; ++i){
+				size_t x0 = i * bits, x1 = std::min(width, x0 + bits);
+
+				word w = 0;
+				for(size_t x = x0; x < x1; ++x)
+					w |= static_cast<word>(source[x] >= level) << (x - x0);
+
+				dest[i] = w;
+			}
+		}
+
+		return result;
+	}
+
+	/** @brief Writes 0xFF for every pixel in `m`, 0x00 for every other one. */
+	void unpack(const mask& m, u8* values){
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < m.height; ++y){
+			const word *source = m.row(y);
+			u8         *dest   = &values[y * m.width];
+
+			for(size_t x = 0; x < m.width; ++x)
+				dest[x] = (source[x / bits] >> (x % bits)) & 1 ? 0xFF : 0x00;
+		}
+	}
+
+	/** @brief Combines two masks of the same size, a word at a time, with `op`. */
+	template<typename Op>
+	mask combine(const mask& a, const mask& b, Op op){
+		if(a.width != b.width || a.height != b.height)
+			throw std::invalid_argument("Masks are not the same size.");
+
+		mask result(a.width, a.height);
+
+		const word *x = a.data.data();
+		const word *y = b.data.data();
+		word       *z = result.data.data();
+
+		#pragma omp parallel for simd schedule(static)
+		for(size_t i = 0; i < result.data.size(); ++i)
+			z[i] = op(x[i], y[i]);
+
+		return result;
+	}
+
+	/** @brief Pixels in both `a` and `b`. */
+	mask intersect(const mask& a, const mask& b){
+		return combine(a, b, [](word x, word y){ return x & y; });
+	}
+
+	/** @brief Pixels in either `a` or `b`. */
+	mask unite(const mask& a, const mask& b){
+		return combine(a, b, [](word x, word y){ return x | y; });
+	}
+
+	/** @brief Pixels in only one of `a` and `b`. */
+	mask exclude(const mask& a, const mask& b){
+		return combine(a, b, [](word x, word y){ return x ^ y; });
+	}
+
+	/** @brief Number of pixels in `m`. */
+	size_t count(const mask& m){
+		size_t total = 0;
+
+		#pragma omp parallel for schedule(static) reduction(+:total)
+		for(size_t i = 0; i < m.data.size(); ++i)
+			total += __builtin_popcountll(m.data[i]);
+
+		return total;
+	}
+
+	/** @brief Grows `m` by a pixel in all eight directions, `times` times.
+	 *
+	 *  Rows are first grown sideways, shifting whole words and carrying the
+	 *  bits that cross into the words next to them, then every row takes in
+	 *  the ones above and below it. */
+	mask dilate(const mask& m, size_t times = 1){
+		mask result = m;
+		mask across(m.width, m.height);
+
+		const size_t words = m.words;
+		const word   tail  = m.tail();
+
+		for(size_t t = 0; t < times && words != 0; ++t){
+			#pragma omp parallel for schedule(static)
+			for(size_t y = 0; y < m.height; ++y){
+				const word *source = result.row(y);
+				word       *dest   = across.row(y);
+
+				for(size_t i = 0; i < words; ++i){
+					word left  = i == 0         ? 0 : source[i - 1] >> (bits - 1);
+					word right = i == words - 1 ? 0 : source[i + 1] << (bits - 1);
+
+					dest[i] = source[i] | (source[i] << 1) | left | (source[i] >> 1) | right;
+				}
+
+				dest[words - 1] &= tail;
+			}
+
+			#pragma omp parallel for schedule(static)
+			for(size_t y = 0; y < m.height; ++y){
+				const word *above = across.row(y == 0            ? y : y - 1);
+				const word *here  = across.row(y);
+				const word *below = across.row(y == m.height - 1 ? y : y + 1);
+				word       *dest  = result.row(y);
+
+				#pragma omp simd
+				for(size_t i = 0; i < words; ++i)
+					dest[i] = above[i] | here[i] | below[i];
+			}
+		}
+
+		return result;
+	}
+
+	/** @brief Packs a row of `m` into the bytes of an R1 row, whatever the byte order of the host. */
+	void write_row(const mask& m, size_t y, u8* bytes){
+		const word *source = m.row(y);
+
+		for(size_t i = 0; i < (m.width + 7) / 8; ++i)
+			bytes[i] = static_cast<u8>(source[i / 8] >> ((i % 8) * 8));
+	}
+
+	/** @brief Reads a row of `m` from the bytes of an R1 row, clearing any bits past its width. */
+	void read_row(mask& m, size_t y, const u8* bytes){
+		word *dest = m.row(y);
+
+		for(size_t i = 0; i < m.words; ++i)
+			dest[i] = 0;
+
+		for(size_t i = 0; i < (m.width + 7) / 8; ++i)
+			dest[i / 8] |= static_cast<word>(bytes[i]) << ((i % 8) * 8);
+
+		if(m.words != 0)
+			dest[m.words - 1] &= m.tail();
+	}
+
+	/** @brief Reads an R1 texture. Throws glt::parse_error if it cannot be read, or is not a mask. */
+	mask load(const std::string& input){
+		glt::texture_header header;
+		FILE *file = effect::open_bitmap(input, header, GLT_PIXEL_FORMAT_R1);
+
+		mask result;
+		std::vector<u8> bytes(header.row_length());
+		try{
+			result = mask(header.width, header.height);
+		}catch(...){
+			fclose(file);
+			throw;
+		}
+
+		for(size_t y = 0; y < result.height; ++y){
+			// Missing texture data is filled with zeros, as per the specification.
+			size_t read = fread(bytes.data(), 1, bytes.size(), file);
+			memset(bytes.data() + read, 0, bytes.size() - read);
+
+			read_row(result, y, bytes.data());
+		}
+
+		fclose(file);
+		return result;
+	}
+
+	/** @brief Writes `m` as an R1 texture. Throws std::runtime_error if the file cannot be created or written. */
+	void save(const mask& m, const std::string& output){
+		effect::row_writer writer(output, m.width, m.height, GLT_PIXEL_FORMAT_R1);
+
+		std::vector<u8> bytes(writer.row_length());
+		for(size_t y = 0; y < m.height; ++y){
+			write_row(m, y, bytes.data());
+			writer.write(bytes.data(), 1);
+		}
+
+		writer.close();
+	}
+}
+
+#endif // __MASKS_H__
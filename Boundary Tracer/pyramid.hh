@@ -0,0 +1,74 @@
+#ifndef __PYRAMID_H__
+#define __PYRAMID_H__
+
+#include "effect.hh"
+
+#include <vector> // For std::vector
+
+/** Image pyramids, where every level is half the size of the one before it. */
+namespace pyramid{
+	/** @brief Halves `input` into `output`, every pixel the average of the 2x2 block it covers.
+	 *
+	 *  `output` must be ((width + 1) / 2) x ((height + 1) / 2), blocks past an
+	 *  odd edge repeat its last row or column. */
+	void halve(const effect::BitmapView& input, const effect::BitmapView& output){
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < output.height; ++y){
+			const effect::Pixel<u8> *top    = input.row(y * 2);
+			const effect::Pixel<u8> *bottom = input.row(std::min(y * 2 + 1, input.height - 1));
+			effect::Pixel<u8>       *dest   = output.row(y);
+
+			for(size_t x = 0; x < output.width; ++x){
+				size_t left  = x * 2;
+				size_t right = std::min(left + 1, input.width - 1);
+
+				#define AVERAGE(component) static_cast<u8>(( \
+					top   [left].component + top   [right].component + \
+					bottom[left].component + bottom[right].component + 2) / 4)
+
+				dest[x] = { AVERAGE(red), AVERAGE(green), AVERAGE(blue), AVERAGE(alpha) };
+
+				#undef AVERAGE
+			}
+		}
+	}
+
+	/** @brief Builds the `count` levels below `input`, each one halved from the one before it. */
+	std::vector<effect::Bitmap> reduce(const effect::BitmapView& input, size_t count, effect::buffer_pool& pool = effect::buffer_pool::global()){
+		std::vector<effect::Bitmap> levels;
+		levels.reserve(count);
+
+		effect::BitmapView above = input;
+		for(size_t l = 0; l < count; ++l){
+			levels.emplace_back((above.width + 1) / 2, (above.height + 1) / 2, pool);
+			halve(above, levels.back());
+
+			above = levels.back();
+		}
+
+		return levels;
+	}
+
+	/** @brief Averages values measured at every level of a pyramid back up at the size of its first.
+	 *
+	 *  `values[l]` holds one byte per pixel of `levels[l]`, pixels of the first
+	 *  level take those of the pixel covering them in every other level. */
+	void combine(const std::vector<effect::BitmapView>& levels, const std::vector<const u8*>& values, u8* combined){
+		const size_t w     = levels[0].width;
+		const size_t h     = levels[0].height;
+		const size_t count = levels.size();
+
+		#pragma omp parallel for schedule(static)
+		for(size_t y = 0; y < h; ++y){
+			for(size_t x = 0; x < w; ++x){
+				size_t sum = 0;
+				for(size_t l = 0; l < count; ++l)
+					sum += values[l][(y >> l) * levels[l].width + (x >> l)];
+
+				combined[y * w + x] = static_cast<u8>((sum + count / 2) / count);
+			}
+		}
+	}
+}
+
+#endif // __PYRAMID_H__
@@ -0,0 +1,117 @@
+#ifndef __STATISTICS_H__
+#define __STATISTICS_H__
+
+#include "effect.hh"
+
+namespace statistics{
+	/** Distribution of the values of a single colour component. */
+	struct channel{
+		size_t histogram[0x100] = { };
+		size_t count = 0;
+
+		u8     min  = 0x00;
+		u8     max  = 0x00;
+		double mean = 0;
+
+		/** @brief Returns the lowest value at or below which a `p` (0 to 1) fraction of the values lie. */
+		const u8 percentile(double p) const{
+			if(count == 0)
+				return 0x00;
+
+			// Number of values that must be at or below the percentile
+			size_t rank = static_cast<size_t>(std::ceil(p * count));
+			if(rank == 0)
+				rank = 1;
+
+			size_t seen = 0;
+			for(size_t v = 0; v < 0x100; ++v){
+				seen += histogram[v];
+				if(seen >= rank)
+					return static_cast<u8>(v);
+			}
+
+			return max;
+		}
+
+		/** @brief Derives min, max and mean from the histogram. */
+		void summarize(){
+			count = 0;
+
+			double sum = 0;
+			for(size_t v = 0; v < 0x100; ++v){
+				count += histogram[v];
+				sum   += static_cast<double>(histogram[v]) * v;
+			}
+
+			mean = count == 0 ? 0 : sum / count;
+
+			min = 0x00;
+			while(min < 0xFF && histogram[min] == 0)
+				++min;
+
+			max = 0xFF;
+			while(max > 0x00 && histogram[max] == 0)
+				--max;
+		}
+	};
+
+	/** Statistics for every component of a bitmap. */
+	struct summary{
+		channel red;
+		channel green;
+		channel blue;
+		channel alpha;
+
+		channel& operator[](size_t component){
+			switch(component){
+				case 0:  return red;
+				case 1:  return green;
+				case 2:  return blue;
+				default: return alpha;
+			}
+		}
+	};
+
+	/** @brief Gathers per-component statistics of a bitmap in a single sweep.
+	 *
+	 *  Every thread fills a private set of histograms over a band of rows,
+	 *  which are only merged once all pixels have been seen. Minimum,
+	 *  maximum, mean and percentiles are then derived from the histograms
+	 *  alone, without going over the pixels again. */
+	summary compute(const effect::BitmapView& bmap){
+		summary result;
+
+		#pragma omp parallel
+		{
+			// Indexed by value first, so the four counters of a grey pixel share a cache line.
+			size_t local[0x100][4] = { };
+
+			#pragma omp for schedule(static) nowait
+			for(size_t y = 0; y < bmap.height; ++y){
+				const effect::Pixel<u8> *row = bmap.row(y);
+
+				for(size_t x = 0; x < bmap.width; ++x){
+					++local[row[x].red  ][0];
+					++local[row[x].green][1];
+					++local[row[x].blue ][2];
+					++local[row[x].alpha][3];
+				}
+			}
+
+			#pragma omp critical
+			for(size_t v = 0; v < 0x100; ++v){
+				result.red  .histogram[v] += local[v][0];
+				result.green.histogram[v] += local[v][1];
+				result.blue .histogram[v] += local[v][2];
+				result.alpha.histogram[v] += local[v][3];
+			}
+		}
+
+		for(size_t c = 0; c < 4; ++c)
+			result[c].summarize();
+
+		return result;
+	}
+}
+
+#endif // __STATISTICS_H__
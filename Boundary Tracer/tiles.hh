@@ -0,0 +1,189 @@
+#ifndef __TILES_H__
+#define __TILES_H__
+
+#include "effect.hh"
+
+#include <vector>    // For std::vector
+
+#include <sys/stat.h> // For stat()
+
+/** Square tiles of an image, and what is remembered of them between runs. */
+namespace tiles{
+	/** Side of a tile, in pixels. Tiles at the right and bottom edges may be smaller. */
+	static const size_t size = 64;
+
+	/** @brief Number of tiles needed to cover `length` pixels. */
+	size_t count(size_t length){
+		return (length + size - 1) / size;
+	}
+
+	/** @brief Hashes the pixels of `tile` with FNV-1a, a whole pixel at a time.
+	 *
+	 *  Every step is a bijection of the state, so changing a single pixel
+	 *  always changes the hash. */
+	u64 hash(const effect::BitmapView& tile){
+		u64 h = 0xCBF29CE484222325;
+
+		for(size_t y = 0; y < tile.height; ++y){
+			const effect::Pixel<u8> *row = tile.row(y);
+
+			for(size_t x = 0; x < tile.width; ++x){
+				u32 pixel;
+				memcpy(&pixel, &row[x], sizeof(pixel));
+
+				h = (h ^ pixel) * 0x100000001B3;
+			}
+		}
+
+		return h;
+	}
+
+	/** @brief Folds `value` into the fingerprint `h`, as hash() folds in pixels. */
+	u64 fold(u64 h, u64 value){
+		return (h ^ value) * 0x100000001B3;
+	}
+
+	u64 fold(u64 h, double value){
+		u64 bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		return fold(h, bits);
+	}
+
+	/** @brief Reads the length of the file at `path`, and when it was last changed, in nanoseconds. Returns false if it cannot be looked at. */
+	bool stamp(const std::string& path, u64& length, u64& changed){
+		struct stat info;
+		if(stat(path.c_str(), &info) != 0)
+			return false;
+
+		length  = info.st_size;
+		changed = static_cast<u64>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+		return true;
+	}
+
+	/** @brief Hashes every tile of `input`, row by row. */
+	std::vector<u64> hash_all(const effect::BitmapView& input){
+		const size_t columns = count(input.width);
+		const size_t rows    = count(input.height);
+
+		std::vector<u64> hashes(columns * rows);
+
+		#pragma omp parallel for schedule(static)
+		for(size_t t = 0; t < hashes.size(); ++t)
+			hashes[t] = hash(input.region((t % columns) * size, (t / columns) * size, size, size));
+
+		return hashes;
+	}
+
+	/** @brief Marks the tiles whose output may have changed, with 1.
+	 *
+	 *  Pixels are traced from the ones around them, so tiles next to one that
+	 *  changed, diagonally too, are marked along with it. */
+	std::vector<u8> changed(const std::vector<u64>& before, const std::vector<u64>& after, size_t columns, size_t rows){
+		std::vector<u8> marks(columns * rows, 0);
+
+		for(size_t ty = 0; ty < rows; ++ty){
+			for(size_t tx = 0; tx < columns; ++tx){
+				if(before[ty * columns + tx] == after[ty * columns + tx])
+					continue;
+
+				for(size_t ny = ty == 0 ? ty : ty - 1; ny <= ty + 1 && ny < rows; ++ny)
+					for(size_t nx = tx == 0 ? tx : tx - 1; nx <= tx + 1 && nx < columns; ++nx)
+						marks[ny * columns + nx] = 1;
+			}
+		}
+
+		return marks;
+	}
+
+	/** What a run of the tracer leaves behind for the next one: the hash of
+	 *  every tile of its input, and the differences measured over it.
+	 *
+	 *  The file starts with a header, followed by the hashes, row by row, and
+	 *  then a byte of difference per pixel. It is written in the machine's own
+	 *  byte order, and is only ever a cache: a file that is missing, was left
+	 *  by another machine, or does not match the input is simply ignored. So
+	 *  is one left by a run that wrote its output some other way, or whose
+	 *  output has since been written over, by any program. */
+	struct cache{
+		struct header{
+			char magic[4] = { 'G', 'L', 'T', 'C' };
+			u32  version  = 2;
+
+			u64 width  = 0;
+			u64 height = 0;
+			u64 tile   = size;
+
+			// What the differences were measured with
+			u8                hue = 0;
+			effect::Pixel<u8> line_color;
+			u8                reserved[3] = { };
+
+			// Fingerprint of how the output was written from the differences,
+			// and the output as it was left: its length, and when it changed
+			u64 settings = 0;
+			u64 length   = 0;
+			u64 changed  = 0;
+		} info;
+
+		std::vector<u64> hashes;
+		std::vector<u8>  differences;
+
+		/** @brief Whether this cache was left by a run over an image of the same size, measured and written out the same way. */
+		bool matches(size_t width, size_t height, bool hue, effect::Pixel<u8> line_color, u64 settings) const{
+			return info.width == width && info.height == height && info.tile == size &&
+			       info.hue == (hue ? 1 : 0) && info.line_color == line_color && info.settings == settings;
+		}
+
+		/** @brief Reads the cache at `path`, returning false if there is none, it is not whole, or it does not match().
+		 *
+		 *  Unless `output` is empty, the file there must also be just as the
+		 *  run that left the cache wrote it. */
+		bool load(const std::string& path, size_t width, size_t height, bool hue, effect::Pixel<u8> line_color, u64 settings, const std::string& output){
+			FILE *file = fopen(path.c_str(), "rb");
+			if(file == NULL)
+				return false;
+
+			header expected;
+			bool whole = fread(&info, sizeof(header), 1, file) == 1 &&
+			             memcmp(info.magic, expected.magic, sizeof(expected.magic)) == 0 &&
+			             info.version == expected.version && matches(width, height, hue, line_color, settings);
+
+			if(whole && !output.empty()){
+				u64 length, changed;
+				whole = stamp(output, length, changed) && length == info.length && changed == info.changed;
+			}
+
+			if(whole){
+				hashes.resize(count(info.width) * count(info.height));
+				differences.resize(info.width * info.height);
+
+				whole = fread(hashes.data(),      sizeof(u64), hashes.size(),      file) == hashes.size() &&
+				        fread(differences.data(), sizeof(u8),  differences.size(), file) == differences.size();
+			}
+
+			fclose(file);
+			return whole;
+		}
+
+		/** @brief Writes the cache to `path`, along with how `output` was left, which must be written in full by now.
+		 *
+		 *  Throws std::runtime_error if the file cannot be created. */
+		void save(const std::string& path, const std::string& output){
+			if(!stamp(output, info.length, info.changed))
+				info.length = info.changed = 0;
+
+			FILE *file = fopen(path.c_str(), "wb");
+			if(file == NULL)
+				throw std::runtime_error("Could not open tile cache file.");
+
+			fwrite(&info,              sizeof(header), 1,                  file);
+			fwrite(hashes.data(),      sizeof(u64),    hashes.size(),      file);
+			fwrite(differences.data(), sizeof(u8),     differences.size(), file);
+
+			fclose(file);
+		}
+	};
+}
+
+#endif // __TILES_H__
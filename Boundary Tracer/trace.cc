@@ -1,127 +1,1193 @@
 #include "effect.hh"
+#include "color.hh"
+#include "edges.hh"
+#include "pyramid.hh"
+#include "contours.hh"
+#include "tiles.hh"
 
-void trace_boundaries(effect::Bitmap* input, effect::Pixel<u8> line_color = {0xFF, 0xFF, 0xFF, 0xFF}){
-	struct boundary{
-		float             difference;
-		effect::Pixel<u8>  color;
+#include <vector>      // For std::vector
+
+/** Per-pixel data the difference metric works on, computed once per pixel.
+ *
+ *  A row of samples holds one plane, `width` bytes long, per field. */
+namespace samples{
+	enum plane{
+		hue,        // Only filled in when tracing with hue
+		saturation,
+		value,
+		ignored,    // 0xFF if the pixel is at line_color or fully transparent, as neighbours these count as no difference
+		line,       // 0xFF if the pixel is at line_color, these are left as they are
+		planes
 	};
+}
+
+/** @brief Computes the samples of a row of pixels. */
+template<bool hue>
+void sample_row(const effect::Pixel<u8>* pixels, u8* row, size_t width, effect::Pixel<u8> line_color){
+	u8 *h = row + samples::hue        * width;
+	u8 *s = row + samples::saturation * width;
+	u8 *v = row + samples::value      * width;
+	u8 *i = row + samples::ignored    * width;
+	u8 *l = row + samples::line       * width;
+	
+	#pragma omp simd
+	for(size_t x = 0; x < width; ++x){
+		effect::Pixel<u8> pixel = pixels[x];
+		
+		if(hue){
+			color::pixel hsv = color::hsv::from_rgb(pixel);
+			h[x] = hsv.red;
+			s[x] = hsv.green;
+			v[x] = hsv.blue;
+		}else{
+			// Same as effect::hsv, which zeroes both unless the pixel is fully opaque
+			u8 opaque = pixel.alpha == 0xFF ? 0xFF : 0x00;
+			
+			h[x] = 0;
+			s[x] = (0xFF - std::min(pixel.red, std::min(pixel.green, pixel.blue))) & opaque;
+			v[x] = std::max(pixel.red, std::max(pixel.green, pixel.blue)) & opaque;
+		}
+		
+		l[x] = pixel.red   == line_color.red   && pixel.green == line_color.green &&
+		       pixel.blue  == line_color.blue  && pixel.alpha == line_color.alpha ? 0xFF : 0x00;
+		i[x] = l[x] | (pixel.alpha == 0 ? 0xFF : 0x00);
+	}
+}
+
+/** @brief Difference between neighbour n and current pixel c, 0 if the neighbour is ignored. */
+template<bool hue>
+inline s32 peak(const u8* rn, size_t n, const u8* rc, size_t c, size_t width){
+	s32 d;
+	if(hue){
+		d = static_cast<s32>(color::difference(
+			{rn[samples::hue * width + n], rn[samples::saturation * width + n], rn[samples::value * width + n]},
+			{rc[samples::hue * width + c], rc[samples::saturation * width + c], rc[samples::value * width + c]}
+		));
+	}else{
+		d = std::max(
+			std::abs(static_cast<s32>(rn[samples::saturation * width + n]) - rc[samples::saturation * width + c]),
+			std::abs(static_cast<s32>(rn[samples::value      * width + n]) - rc[samples::value      * width + c])
+		);
+	}
+	
+	return d & ~static_cast<s32>(rn[samples::ignored * width + n]);
+}
+
+/** @brief Traces the pixels from x0 to x1 of a row, near the edges of the image.
+ *
+ *  Rows above and below are given as pixels and samples. Past the top and
+ *  bottom edges of the image they must be the current row itself, just as
+ *  neighbours past the left and right edges are replaced by the current pixel.
+ *  Diagonal neighbours fall back to the current pixel as soon as either of
+ *  their coordinates is out of bounds. With `average` set, colours are written
+ *  to `colors`, with their alpha left to be filled in once differences are
+ *  normalized. */
+template<bool hue, bool average>
+void trace_border(const effect::Pixel<u8>* above, const effect::Pixel<u8>* here, const effect::Pixel<u8>* below,
+                  const u8* s_above, const u8* s_here, const u8* s_below,
+                  size_t width, bool first_row, bool last_row, size_t x0, size_t x1,
+                  u8* differences, effect::Pixel<u8>* colors, effect::Pixel<u8> line_color){
+	const u8 *line = s_here + samples::line * width;
+	
+	for(size_t x = x0; x < x1; ++x){
+		// Ignore if already at line_color
+		if(line[x]){
+			differences[x] = 0;
+			if(average)
+				colors[x] = line_color;
+			continue;
+		}
+		
+		const bool first_column = x == 0;
+		const bool last_column  = x == width - 1;
+		
+		const size_t left  = first_column ? x : x - 1;
+		const size_t right = last_column  ? x : x + 1;
+		
+		// Diagonals fall back to the current pixel as a whole
+		const bool tl_self = first_row || first_column;
+		const bool br_self = last_row  || last_column;
+		const bool tr_self = first_row || last_column;
+		const bool bl_self = last_row  || first_column;
+		
+		const size_t tl = tl_self ? x : x - 1,  br = br_self ? x : x + 1;
+		const size_t tr = tr_self ? x : x + 1,  bl = bl_self ? x : x - 1;
+		
+		const u8 *s_tl = tl_self ? s_here : s_above,  *s_br = br_self ? s_here : s_below;
+		const u8 *s_tr = tr_self ? s_here : s_above,  *s_bl = bl_self ? s_here : s_below;
+		
+		// Average the difference over the four axes, each taking its highest side
+		differences[x] = static_cast<u8>((
+			std::max(peak<hue>(s_here,  left, s_here, x, width), peak<hue>(s_here,  right, s_here, x, width)) +
+			std::max(peak<hue>(s_below, x,    s_here, x, width), peak<hue>(s_above, x,     s_here, x, width)) +
+			std::max(peak<hue>(s_tl,    tl,   s_here, x, width), peak<hue>(s_br,    br,    s_here, x, width)) +
+			std::max(peak<hue>(s_tr,    tr,   s_here, x, width), peak<hue>(s_bl,    bl,    s_here, x, width))
+		) / 4);
+		
+		if(!average)
+			continue;
+		
+		// Average the current pixel's color along with the other pixels'
+		const effect::Pixel<u8> *p_tl = tl_self ? here : above,  *p_br = br_self ? here : below;
+		const effect::Pixel<u8> *p_tr = tr_self ? here : above,  *p_bl = bl_self ? here : below;
+		
+		#define SUM(component) \
+			static_cast<u8>((static_cast<u32>(here[x].component) + here[left].component + here[right].component + \
+			                 below[x].component + above[x].component + p_tl[tl].component + p_br[br].component + \
+			                 p_tr[tr].component + p_bl[bl].component) / 9)
+		
+		colors[x] = {SUM(red), SUM(green), SUM(blue), SUM(alpha)};
+		
+		#undef SUM
+	}
+}
+
+/** @brief Traces the pixels from x0 to x1 of a row away from the edges of the image.
+ *
+ *  Does the same as trace_border(), without any of the bounds checks, as
+ *  straight-line loops the compiler can vectorize. */
+template<bool hue, bool average>
+void trace_interior(const effect::Pixel<u8>* above, const effect::Pixel<u8>* here, const effect::Pixel<u8>* below,
+                    const u8* s_above, const u8* s_here, const u8* s_below,
+                    size_t width, size_t x0, size_t x1,
+                    u8* differences, effect::Pixel<u8>* colors, effect::Pixel<u8> line_color){
+	const u8 *line = s_here + samples::line * width;
+	
+	#pragma omp simd
+	for(size_t x = x0; x < x1; ++x){
+		s32 difference = (
+			std::max(peak<hue>(s_here,  x - 1, s_here, x, width), peak<hue>(s_here,  x + 1, s_here, x, width)) +
+			std::max(peak<hue>(s_below, x,     s_here, x, width), peak<hue>(s_above, x,     s_here, x, width)) +
+			std::max(peak<hue>(s_above, x - 1, s_here, x, width), peak<hue>(s_below, x + 1, s_here, x, width)) +
+			std::max(peak<hue>(s_above, x + 1, s_here, x, width), peak<hue>(s_below, x - 1, s_here, x, width))
+		) / 4;
+		
+		// Pixels already at line_color are left with no difference
+		differences[x] = static_cast<u8>(difference & ~static_cast<s32>(line[x]));
+	}
+	
+	if(!average)
+		return;
+	
+	// Components of the 3x3 neighbourhood are summed in place, four per pixel
+	const u8 *a = (const u8*) above, *h = (const u8*) here, *b = (const u8*) below;
+	u8 *c = (u8*) colors;
+	
+	#pragma omp simd
+	for(size_t i = x0 * 4; i < x1 * 4; ++i){
+		c[i] = static_cast<u8>((static_cast<u32>(a[i - 4]) + a[i] + a[i + 4] +
+		                        h[i - 4] + h[i] + h[i + 4] +
+		                        b[i - 4] + b[i] + b[i + 4]) / 9);
+	}
+	
+	for(size_t x = x0; x < x1; ++x){
+		if(line[x])
+			colors[x] = line_color;
+	}
+}
+
+/** @brief Traces the pixels from x0 to x1 of a row, taking the border path only for the first and
+ *  last columns of the image, or for rows at its edges. */
+template<bool hue, bool average = true>
+void trace_span(const effect::Pixel<u8>* above, const effect::Pixel<u8>* here, const effect::Pixel<u8>* below,
+                const u8* s_above, const u8* s_here, const u8* s_below,
+                size_t width, bool first_row, bool last_row, size_t x0, size_t x1,
+                u8* differences, effect::Pixel<u8>* colors, effect::Pixel<u8> line_color){
+	if(first_row || last_row || width < 3){
+		trace_border<hue, average>(above, here, below, s_above, s_here, s_below, width, first_row, last_row,
+		                           x0, x1, differences, colors, line_color);
+		return;
+	}
+	
+	const size_t i0 = std::max<size_t>(x0, 1);
+	const size_t i1 = std::max(i0, std::min(x1, width - 1));
+	
+	if(x0 < i0)
+		trace_border<hue, average>(above, here, below, s_above, s_here, s_below, width, false, false,
+		                           x0, i0, differences, colors, line_color);
+	if(i0 < i1)
+		trace_interior<hue, average>(above, here, below, s_above, s_here, s_below, width,
+		                             i0, i1, differences, colors, line_color);
+	if(i1 < x1)
+		trace_border<hue, average>(above, here, below, s_above, s_here, s_below, width, false, false,
+		                           i1, x1, differences, colors, line_color);
+}
+
+/** @brief Traces a whole row, as trace_span() does. */
+template<bool hue, bool average = true>
+void trace_row(const effect::Pixel<u8>* above, const effect::Pixel<u8>* here, const effect::Pixel<u8>* below,
+               const u8* s_above, const u8* s_here, const u8* s_below,
+               size_t width, bool first_row, bool last_row,
+               u8* differences, effect::Pixel<u8>* colors, effect::Pixel<u8> line_color){
+	trace_span<hue, average>(above, here, below, s_above, s_here, s_below, width, first_row, last_row,
+	                         0, width, differences, colors, line_color);
+}
+
+/** @brief Finds the highest difference, and the first place it shows up in, column by column.
+ *
+ *  Both searches are reductions over the rows, whose result does not depend
+ *  on how the rows are split between threads: the place is the lowest
+ *  column-major index the highest difference is found at in any of them. */
+u8 highest_difference(const u8* differences, size_t width, size_t height, size_t& highest_x, size_t& highest_y){
+	u8 highest = 0;
 	
-	boundary **tmap = (boundary**) malloc(input->width * sizeof(boundary*));
-	for(size_t i = 0; i < input->width; ++i){
-		tmap[i] = (boundary*) malloc(input->height * sizeof(boundary));
+	#pragma omp parallel for schedule(static) reduction(max:highest)
+	for(size_t y = 0; y < height; ++y){
+		const u8 *row = &differences[y * width];
+		
+		for(size_t x = 0; x < width; ++x)
+			highest = std::max(highest, row[x]);
 	}
 	
-	// Scan horizontally for boundaries
-	for(size_t y = 0; y < input->height; ++y){
-		for(size_t x = 0; x < input->width; ++x){
-			// Get current pixel
-			effect::Pixel<u8> *current = &input->data[y * input->width + x];
+	highest_x = 0;
+	highest_y = 0;
+	if(highest == 0)
+		return highest;
+	
+	size_t first = width * height;
+	
+	#pragma omp parallel for schedule(static) reduction(min:first)
+	for(size_t y = 0; y < height; ++y){
+		const u8 *row   = &differences[y * width];
+		const u8 *found = (const u8*) memchr(row, highest, width);
+		
+		if(found != NULL)
+			first = std::min(first, static_cast<size_t>(found - row) * height + y);
+	}
+	
+	highest_x = first / height;
+	highest_y = first % height;
+	
+	return highest;
+}
+
+/** How differences are scaled into the alpha of traced boundaries, or into edge maps. */
+struct normalization{
+	enum{
+		highest,  // The highest difference is opaque, which needs all of them known first
+		fixed,    // `scale` is opaque
+		sampled,  // The highest difference in every `step`th row is opaque
+		quantile  // The `q` quantile of the differences in every `step`th row is opaque
+	} mode = highest;
+	
+	u8     scale = 0xFF;
+	size_t step  = 16;
+	double q     = 0.999;
+	
+	/** @brief First of the rows looked at when sampling an image `height` rows high. */
+	size_t first(size_t height) const{
+		return std::min(step / 2, height - 1);
+	}
+	
+	/** @brief Scale for the differences in the sampled rows, counted by value. */
+	u8 of(const size_t histogram[0x100]) const{
+		size_t count = 0;
+		for(size_t d = 0; d < 0x100; ++d)
+			count += histogram[d];
+		
+		if(count == 0)
+			return 0x00;
+		
+		// The highest is the 1 quantile
+		size_t rank = mode == sampled ? count : static_cast<size_t>(std::ceil(q * count));
+		if(rank == 0)
+			rank = 1;
+		
+		size_t seen = 0;
+		for(size_t d = 0; d < 0x100; ++d){
+			seen += histogram[d];
+			if(seen >= rank)
+				return static_cast<u8>(d);
+		}
+		
+		return 0xFF;
+	}
+};
+
+/** @brief Finds the difference to be drawn opaque, as `norm` asks for, and reports it.
+ *
+ *  Scaling to anything but the highest difference clips the ones above it,
+ *  so a few outliers cannot wash all the others out. */
+u8 scale_of(const u8* differences, size_t width, size_t height, const normalization& norm){
+	if(norm.mode == normalization::highest){
+		// Get the hihest value
+		size_t highest_x, highest_y;
+		float highest_diff = highest_difference(differences, width, height, highest_x, highest_y);
+		
+		printf("Highest diff: %f (%zu, %zu)\n", highest_diff, highest_x, highest_y);
+		return static_cast<u8>(highest_diff);
+	}
+	
+	u8 scale = norm.scale;
+	if(norm.mode != normalization::fixed){
+		size_t histogram[0x100] = { };
+		for(size_t y = norm.first(height); y < height; y += norm.step)
+			for(size_t x = 0; x < width; ++x)
+				++histogram[differences[y * width + x]];
+		
+		scale = norm.of(histogram);
+	}
+	
+	printf("Scale: %u\n", scale);
+	return scale;
+}
+
+/** @brief Sets the alpha of every pixel in `output` to its difference, scaled by `alpha_per_diff`. */
+void write_alpha(const effect::BitmapView& output, const u8* differences, float alpha_per_diff){
+	u8 alpha[0x100];
+	for(size_t d = 0; d < 0x100; ++d)
+		alpha[d] = static_cast<u8>(std::min(255.0f, static_cast<float>(d) * alpha_per_diff));
+	
+	#pragma omp parallel for schedule(static)
+	for(size_t y = 0; y < output.height; ++y){
+		effect::Pixel<u8> *row  = output.row(y);
+		const u8          *diff = &differences[y * output.width];
+		
+		for(size_t x = 0; x < output.width; ++x)
+			row[x].alpha = alpha[diff[x]];
+	}
+}
+
+/** @brief Lowest difference in a region that is at least `threshold` (0 to 1) of `highest`, never 0. */
+u8 threshold_level(double threshold, u8 highest){
+	return static_cast<u8>(std::max(1.0, std::ceil(threshold * highest)));
+}
+
+/** Scales differences so that `highest` spans the whole range of a single
+ *  channel format, clipping those above it, laying them out as its pixels.
+ *
+ *  R8 values are the alpha trace_boundaries() would have given the pixel.
+ *  R1 sets the pixels whose differences are at least `threshold` of the
+ *  highest one, packed as the format asks for. */
+struct edge_quantizer{
+	u16 table[0x100];
+	u64 format;
+	
+	edge_quantizer(u8 highest, u64 format, double threshold = 0.5){
+		this->format = format;
+		
+		if(format == GLT_PIXEL_FORMAT_R1){
+			const u8 level = threshold_level(threshold, highest);
+			for(size_t d = 0; d < 0x100; ++d)
+				table[d] = d >= level ? 1 : 0;
 			
-			// Ignore if already at line_color
-			if(*current == line_color){
-				tmap[x][y] = {0, line_color};
-				continue;
+			return;
+		}
+		
+		float alpha_per_diff = 0xFF / (highest == 0 ? 1.0f : highest);
+		for(size_t d = 0; d < 0x100; ++d){
+			if(format == GLT_PIXEL_FORMAT_R16)
+				table[d] = static_cast<u16>(highest == 0 ? 0 : std::min<size_t>(0xFFFF, (d * 0xFFFF + highest / 2) / highest));
+			else
+				table[d] = static_cast<u8>(std::min(255.0f, static_cast<float>(d) * alpha_per_diff));
+		}
+	}
+	
+	/** @brief Quantizes a row of `width` differences into `row`. */
+	void operator()(const u8* differences, size_t width, u8* row) const{
+		if(format == GLT_PIXEL_FORMAT_R16){
+			// Little-endian, whatever the host is
+			for(size_t x = 0; x < width; ++x){
+				row[x * 2]     = static_cast<u8>(table[differences[x]]);
+				row[x * 2 + 1] = static_cast<u8>(table[differences[x]] >> 8);
 			}
-			
-			// Get hsv data for the previous, current and next Pixel<u8>s
-			#define LEFT   input->data[y * input->width + (x == 0 ? x : x - 1)]
-			#define RIGHT  input->data[y * input->width + (x == input->width - 1 ? x : x + 1)]
-			#define TOP    input->data[(y == 0 ? y : y - 1)                 * input->width + x]
-			#define BOTTOM input->data[(y == input->height - 1 ? y : y + 1) * input->width + x]
-			#define TL     input->data[(y == 0 || x == 0 ? y : y - 1) * input->width \
-			                         + (y == 0 || x == 0 ? x : x - 1)]
-			#define BR     input->data[(y == input->height - 1 || x == input->width - 1 ? y : y + 1) * input->width \
-			                         + (y == input->height - 1 || x == input->width - 1 ? x : x + 1)]
-			#define TR     input->data[(y == 0 || x == input->width - 1 ? y : y - 1) * input->width \
-			                         + (y == 0 || x == input->width - 1 ? x : x + 1)]
-			#define BL     input->data[(y == input->height - 1 || x == 0 ? y : y + 1) * input->width \
-			                         + (y == input->height - 1 || x == 0 ? x : x - 1)]
-			
-			#define DIFFERENCE(s1, s2) \
-				std::max( \
-					(s1 == line_color || s1.alpha == 0 ? \
-					effect::hsv(current) : effect::hsv(&s1)).diff(effect::hsv(current)).peak(), \
-					(s2 == line_color || s2.alpha == 0 ? \
-					effect::hsv(current) : effect::hsv(&s2)).diff(effect::hsv(current)).peak()  \
-				)
-			
-			boundary b;
-			// Pick the hiest of the three differences to represent this pixel
-			b.difference = (DIFFERENCE(LEFT, RIGHT) + DIFFERENCE(BOTTOM, TOP) + DIFFERENCE(TL, BR) + DIFFERENCE(TR, BL)) / 4;
-			
-			// Average the current pixel's color along with the other pixels'
-			b.color = (((*current).cast<size_t>()
-			             + LEFT.cast<size_t>()   + RIGHT.cast<size_t>() 
-			             + BOTTOM.cast<size_t>() + TOP.cast<size_t>() 
-			             + TL.cast<size_t>()     + BR.cast<size_t>() 
-			             + TR.cast<size_t>()     + BL.cast<size_t>()) / 9).cast<u8>();
-			
-			tmap[x][y] = b;
-			
-			
-			#undef LEFT
-			#undef RIGHT
-			#undef UP
-			#undef DOWN
-			#undef TL
-			#undef BR
-			#undef TR
-			#undef BL
-			
-			#undef DIFFERENCE
-		}
-	}
-	
-	// Get the hihest value
-	float highest_diff = 0;
-	size_t highest_x = 0;
-	size_t highest_y = 0;
-	for(size_t x = 0; x < input->width; ++x){
-		for(size_t y = 0; y < input->height; ++y){
-			size_t i = tmap[x][y].difference;
-			if(i > highest_diff){
-				highest_x = x;
-				highest_y = y;
+		}else if(format == GLT_PIXEL_FORMAT_R1){
+			// Eight to a byte, the leftmost in the lowest bit
+			for(size_t i = 0; i < (width + 7) / 8; ++i){
+				u8 bits = 0;
+				for(size_t x = i * 8; x < std::min(width, i * 8 + 8); ++x)
+					bits |= table[differences[x]] << (x - i * 8);
 				
-				highest_diff = i;
+				row[i] = bits;
 			}
+		}else{
+			for(size_t x = 0; x < width; ++x)
+				row[x] = static_cast<u8>(table[differences[x]]);
 		}
 	}
-	
-	printf("Highest diff: %f (%zu, %zu)\n", highest_diff, highest_x, highest_y);
+};
+
+/** @brief Normalizes `differences` into the alpha of `output`, so that the highest one, or
+ *  whichever `norm` asks for, is opaque. */
+void write_boundaries(const u8* differences, const effect::BitmapView& output, const normalization& norm = normalization()){
+	float highest_diff = scale_of(differences, output.width, output.height, norm);
 	
 	// Get the alpha value for every 1 of difference
 	float alpha_per_diff = 0xFF / (highest_diff == 0 ? 1 : highest_diff);
 	
-	// Write map onto the image
-	for(size_t x = 0; x < input->width; ++x){
-		for(size_t y = 0; y < input->height; ++y){
-			input->data[y * input->width + x] = {
-				tmap[x][y].color.red,
-				tmap[x][y].color.green,
-				tmap[x][y].color.blue,
-				static_cast<u8>(tmap[x][y].difference * alpha_per_diff)
-			};
+	// Write map onto the output image
+	write_alpha(output, differences, alpha_per_diff);
+}
+
+/** @brief Normalizes `differences` as write_boundaries() does, writing them out as the single channel `output`.
+ *
+ *  Masks are set where differences are at least `threshold` (0 to 1) of the
+ *  scale. */
+void write_edges(const u8* differences, size_t width, size_t height, effect::row_writer& output,
+                 const normalization& norm = normalization(), double threshold = 0.5){
+	edge_quantizer quantize(scale_of(differences, width, height, norm), output.format(), threshold);
+	std::vector<u8> row(output.row_length());
+	
+	for(size_t y = 0; y < height; ++y){
+		quantize(&differences[y * width], width, row.data());
+		output.write(row.data(), 1);
+	}
+}
+
+/** @brief Samples and traces every row of `count` images, writing their differences.
+ *
+ *  The averaged colours of `inputs[i]` are written to `outputs[i]`, which must
+ *  not overlap it, unless that is left empty, in which case the averaging is
+ *  skipped altogether.
+ *
+ *  Every pass is split between threads in bands of rows, rows of every image
+ *  counted one after the other, so smaller images are traced alongside the
+ *  others rather than after them. Bands read the rows just outside of them
+ *  from the shared sample planes, which are all filled in before tracing
+ *  starts, so they need nothing from one another and the result is the same
+ *  for any number of threads. */
+template<bool hue>
+void trace_images(const effect::BitmapView* inputs, const effect::BitmapView* outputs, u8* const* differences, size_t count, effect::Pixel<u8> line_color){
+	// Index of the first row of every image, and past the last one
+	std::vector<size_t> first(count + 1, 0);
+	std::vector<std::vector<u8>> planes(count);
+	
+	for(size_t i = 0; i < count; ++i){
+		first[i + 1] = first[i] + inputs[i].height;
+		planes[i].resize(inputs[i].height * inputs[i].width * samples::planes);
+	}
+	
+	// Image a row belongs to, and its index in it
+	auto locate = [&](size_t r, size_t& y){
+		size_t i = 0;
+		while(r >= first[i + 1])
+			++i;
+		
+		y = r - first[i];
+		return i;
+	};
+	
+	#pragma omp parallel
+	{
+		#pragma omp for schedule(static)
+		for(size_t r = 0; r < first[count]; ++r){
+			size_t y, i = locate(r, y);
+			
+			const effect::BitmapView& input = inputs[i];
+			const size_t stride = input.width * samples::planes;
+			
+			sample_row<hue>(input.row(y), &planes[i][y * stride], input.width, line_color);
+		}
+		
+		// Scan for boundaries
+		#pragma omp for schedule(static)
+		for(size_t r = 0; r < first[count]; ++r){
+			size_t y, i = locate(r, y);
+			
+			const effect::BitmapView& input = inputs[i];
+			const size_t w = input.width;
+			const size_t h = input.height;
+			const size_t stride = w * samples::planes;
+			const u8 *plane = planes[i].data();
+			
+			size_t above = y == 0     ? y : y - 1;
+			size_t below = y == h - 1 ? y : y + 1;
+			
+			if(outputs[i].data != NULL)
+				trace_row<hue, true>(
+					input.row(above),          input.row(y),          input.row(below),
+					&plane[above * stride],    &plane[y * stride],    &plane[below * stride],
+					w, y == 0, y == h - 1,
+					&differences[i][y * w], outputs[i].row(y), line_color
+				);
+			else
+				trace_row<hue, false>(
+					input.row(above),          input.row(y),          input.row(below),
+					&plane[above * stride],    &plane[y * stride],    &plane[below * stride],
+					w, y == 0, y == h - 1,
+					&differences[i][y * w], NULL, line_color
+				);
+		}
+	}
+}
+
+/** @brief Traces the tiles of `input` marked in `marks`, as trace_image() would, leaving the others alone.
+ *  Colours are only averaged if `output` is not left empty.
+ *
+ *  Tiles are traced in parallel, each sampling its own pixels, along with a
+ *  pixel of the ones around it, into scratch rows of its own. Rows of these
+ *  start at the leftmost column sampled, so the tile's columns are traced
+ *  at an offset, through trace_span(), as if the image started there. The
+ *  first and last columns of the image only ever land on the edges of the
+ *  scratch rows, so the results are those of a whole trace. Returns how
+ *  many tiles were traced. */
+template<bool hue>
+size_t trace_tiles(const effect::BitmapView& input, const effect::BitmapView& output, u8* differences,
+                   const std::vector<u8>& marks, effect::Pixel<u8> line_color){
+	const size_t w = input.width;
+	const size_t h = input.height;
+	const size_t columns = tiles::count(w);
+	
+	std::vector<size_t> marked;
+	for(size_t t = 0; t < marks.size(); ++t)
+		if(marks[t])
+			marked.push_back(t);
+	
+	#pragma omp parallel
+	{
+		// A tile's rows, and one on either side, as wide as a tile and the pixels on either side
+		const size_t stride = (tiles::size + 2) * samples::planes;
+		std::vector<u8> planes((tiles::size + 2) * stride);
+		
+		#pragma omp for schedule(dynamic)
+		for(size_t i = 0; i < marked.size(); ++i){
+			size_t x0 = (marked[i] % columns) * tiles::size, x1 = std::min(w, x0 + tiles::size);
+			size_t y0 = (marked[i] / columns) * tiles::size, y1 = std::min(h, y0 + tiles::size);
+			
+			// Columns and rows sampled
+			size_t sx0 = x0 == 0 ? x0 : x0 - 1, sx1 = std::min(w, x1 + 1);
+			size_t sy0 = y0 == 0 ? y0 : y0 - 1, sy1 = std::min(h, y1 + 1);
+			
+			const size_t sw = sx1 - sx0;
+			const size_t ss = sw * samples::planes;
+			
+			#define SAMPLES(y) (&planes[((y) - sy0) * ss])
+			
+			for(size_t y = sy0; y < sy1; ++y)
+				sample_row<hue>(input.row(y) + sx0, SAMPLES(y), sw, line_color);
+			
+			for(size_t y = y0; y < y1; ++y){
+				size_t above = y == 0     ? y : y - 1;
+				size_t below = y == h - 1 ? y : y + 1;
+				
+				if(output.data != NULL)
+					trace_span<hue, true>(
+						input.row(above) + sx0,    input.row(y) + sx0,    input.row(below) + sx0,
+						SAMPLES(above),            SAMPLES(y),            SAMPLES(below),
+						sw, y == 0, y == h - 1, x0 - sx0, x1 - sx0,
+						&differences[y * w + sx0], output.row(y) + sx0, line_color
+					);
+				else
+					trace_span<hue, false>(
+						input.row(above) + sx0,    input.row(y) + sx0,    input.row(below) + sx0,
+						SAMPLES(above),            SAMPLES(y),            SAMPLES(below),
+						sw, y == 0, y == h - 1, x0 - sx0, x1 - sx0,
+						&differences[y * w + sx0], NULL, line_color
+					);
+			}
+			
+			#undef SAMPLES
+		}
+	}
+	
+	return marked.size();
+}
+
+/** @brief Samples and traces every row of `input`, as trace_images() does for a single image. */
+template<bool hue>
+void trace_image(const effect::BitmapView& input, const effect::BitmapView& output, u8* differences, effect::Pixel<u8> line_color){
+	trace_images<hue>(&input, &output, &differences, 1, line_color);
+}
+
+/** @brief Measures differences at every level of a pyramid and averages them at the size of the first.
+ *
+ *  The averaged colours of the first level are written to `output`, unless it
+ *  is left empty. */
+template<bool hue>
+void measure_scales(const std::vector<effect::BitmapView>& levels, const effect::BitmapView& output, u8* differences, effect::Pixel<u8> line_color){
+	std::vector<effect::BitmapView> outputs(levels.size());
+	outputs[0] = output;
+	
+	std::vector<std::vector<u8>> measured(levels.size());
+	std::vector<u8*>             pointers(levels.size());
+	
+	for(size_t l = 0; l < levels.size(); ++l){
+		measured[l].resize(levels[l].length());
+		pointers[l] = measured[l].data();
+	}
+	
+	trace_images<hue>(levels.data(), outputs.data(), pointers.data(), levels.size(), line_color);
+	pyramid::combine(levels, std::vector<const u8*>(pointers.begin(), pointers.end()), differences);
+}
+
+/** @brief Measures differences with an edge operator at every level of a pyramid, as measure_scales() does. */
+void measure_scales(const std::vector<effect::BitmapView>& levels, const edges::detector& detect, u8* differences){
+	std::vector<std::vector<u8>> measured(levels.size());
+	std::vector<const u8*>       pointers(levels.size());
+	
+	for(size_t l = 0; l < levels.size(); ++l){
+		measured[l].resize(levels[l].length());
+		pointers[l] = measured[l].data();
+		
+		detect(levels[l], measured[l].data());
+	}
+	
+	pyramid::combine(levels, pointers, differences);
+}
+
+/** Traces the boundaries in `input` into `output`, where the colour of each pixel
+ *  is the average of its neighbourhood and the alpha is how much it differs from
+ *  it. With `hue` set, differences are measured by color::difference() rather
+ *  than by the hue-less effect::hsv. `output` must not overlap `input`.
+ *
+ *  The samples the differences are taken from are computed once per pixel, up
+ *  front, rather than once per neighbour, and colours are written to the output
+ *  right away, so only the differences are kept until they can be normalized. */
+template<bool hue>
+void trace_boundaries(const effect::BitmapView& input, const effect::BitmapView& output, effect::Pixel<u8> line_color){
+	const size_t w = input.width;
+	const size_t h = input.height;
+	
+	std::vector<u8> differences(w * h);
+	trace_image<hue>(input, output, differences.data(), line_color);
+	
+	write_boundaries(differences.data(), output);
+}
+
+/** How the differences boundaries are traced from are measured. */
+struct metric{
+	bool hue     = false; // Through color::difference(), rather than effect::hsv
+	bool operate = false; // With `detector`, rather than the tracer's own kernels
+	
+	edges::detector   detector;
+	effect::Pixel<u8> line_color = {0xFF, 0xFF, 0xFF, 0xFF};
+};
+
+/** @brief Measures how much every pixel of the first level of a pyramid differs from its neighbourhood.
+ *
+ *  With more than one level, differences are averaged over all of them, as
+ *  measure_scales() does, weakening edges that show up at a single scale,
+ *  such as noise. Unless `colors` is left empty, the colours boundaries are
+ *  drawn in are written to it: those of the neighbourhood for the tracer's
+ *  own metric, the pixels' own for edge operators. */
+void measure(const std::vector<effect::BitmapView>& levels, const effect::BitmapView& colors, u8* differences, const metric& m){
+	const effect::BitmapView& input = levels[0];
+	
+	if(m.operate){
+		if(levels.size() > 1)
+			measure_scales(levels, m.detector, differences);
+		else
+			m.detector(input, differences);
+		
+		if(colors.data != NULL){
+			#pragma omp parallel for schedule(static)
+			for(size_t y = 0; y < input.height; ++y)
+				memcpy(colors.row(y), input.row(y), input.width * sizeof(effect::Pixel<u8>));
 		}
+	}else if(levels.size() > 1){
+		if(m.hue)
+			measure_scales<true>(levels, colors, differences, m.line_color);
+		else
+			measure_scales<false>(levels, colors, differences, m.line_color);
+	}else{
+		if(m.hue)
+			trace_image<true>(input, colors, differences, m.line_color);
+		else
+			trace_image<false>(input, colors, differences, m.line_color);
 	}
+}
+
+/** @brief Measures `input` as measure() does, only tracing again the tiles that changed since the run
+ *  that left the tile cache at `path`.
+ *
+ *  Differences of every other tile are taken from the cache, and so are its
+ *  colours, which must still be in `colors` if `kept` is set. Then the cache
+ *  must also have been left with the same `settings`, and the file at
+ *  `output`, where the colours were kept, just as that run wrote it.
+ *  Otherwise, or without a matching cache, the whole image is traced. The
+ *  cache is removed before anything is traced, so that a run cut short leaves
+ *  none behind, and returned once all differences are known, to be saved
+ *  when the output is written. Only the tracer's own metric, over a single
+ *  level, is measured this way. */
+tiles::cache measure_changes(const effect::BitmapView& input, const effect::BitmapView& colors, bool kept,
+                             u8* differences, const metric& m, const std::string& path, u64 settings, const std::string& output){
+	const size_t columns = tiles::count(input.width);
+	const size_t rows    = tiles::count(input.height);
+	
+	tiles::cache cache;
+	std::vector<u64> hashes = tiles::hash_all(input);
+	
+	std::vector<u8> marks(columns * rows, 1);
+	if(kept && cache.load(path, input.width, input.height, m.hue, m.line_color, settings, output)){
+		marks = tiles::changed(cache.hashes, hashes, columns, rows);
+		memcpy(differences, cache.differences.data(), input.length());
+	}
+	
+	remove(path.c_str());
+	
+	size_t traced;
+	if(m.hue)
+		traced = trace_tiles<true>(input, colors, differences, marks, m.line_color);
+	else
+		traced = trace_tiles<false>(input, colors, differences, marks, m.line_color);
+	
+	printf("Traced %zu of %zu tiles\n", traced, marks.size());
+	
+	cache.info.width      = input.width;
+	cache.info.height     = input.height;
+	cache.info.hue        = m.hue ? 1 : 0;
+	cache.info.line_color = m.line_color;
+	cache.info.settings   = settings;
 	
-	free(tmap);
+	cache.hashes = std::move(hashes);
+	cache.differences.assign(differences, differences + input.length());
+	return cache;
+}
+
+/** @brief Outlines the regions whose differences are at least `threshold` (0 to 1) of the highest one,
+ *  or of whichever `norm` asks for.
+ *
+ *  Regions are labelled and outlined by the contours module, and written to
+ *  `output` as text. */
+void write_contours(const u8* differences, size_t width, size_t height, double threshold, const std::string& output, const normalization& norm = normalization()){
+	u8 highest = scale_of(differences, width, height, norm);
+	
+	const u8 level = threshold_level(threshold, highest);
+	
+	std::vector<u8> mask(width * height);
+	
+	#pragma omp parallel for schedule(static)
+	for(size_t y = 0; y < height; ++y)
+		for(size_t x = 0; x < width; ++x)
+			mask[y * width + x] = differences[y * width + x] >= level;
+	
+	std::vector<contours::index> labels(width * height);
+	size_t regions = contours::label(mask.data(), width, height, labels.data());
+	
+	std::vector<contours::polyline> lines = contours::outline(mask.data(), labels.data(), width, height);
+	contours::write(lines, width, height, regions, output);
 	
+	printf("Regions: %zu, contours: %zu\n", regions, lines.size());
 }
 
-int main(int /*argc*/, char** argv){
-	// Load the texture into a buffer
-	glt::file sourcef(argv[1]);
+/** @brief Streams the rows of `input` through a window of three rows.
+ *
+ *  Calls visit(y, above, here, below, s_above, s_here, s_below) for every row
+ *  of the image, in order, with its pixels and samples and those of the rows
+ *  around it. Only those three rows are kept in memory. */
+template<bool hue, typename Visitor>
+void stream_rows(effect::row_reader& input, effect::Pixel<u8> line_color, Visitor visit){
+	const size_t w = input.width();
+	const size_t h = input.height();
+	const size_t stride = w * samples::planes;
 	
-	// Create a bitmap representing that texture
-	effect::Bitmap source;
-	source.width  = sourcef.get_texture_header().width;
-	source.height = sourcef.get_texture_header().height;
-	source.data   = (effect::Pixel<u8>*) sourcef.get_texture_data();
+	std::vector<effect::Pixel<u8>> pixels(3 * w);
+	std::vector<u8>                plane(3 * stride);
+	
+	// Rows go around the window, row y living in slot y % 3
+	#define PIXELS(y)  (&pixels[((y) % 3) * w])
+	#define SAMPLES(y) (&plane[((y) % 3) * stride])
+	
+	input.restart();
+	for(size_t y = 0; y < h; ++y){
+		// Bring in the row below, and the current one if this is the first
+		for(size_t next = y == 0 ? 0 : y + 1; next <= y + 1 && next < h; ++next){
+			input.read(PIXELS(next), 1);
+			sample_row<hue>(PIXELS(next), SAMPLES(next), w, line_color);
+		}
+		
+		size_t above = y == 0     ? y : y - 1;
+		size_t below = y == h - 1 ? y : y + 1;
+		
+		visit(y, PIXELS(above), PIXELS(y), PIXELS(below), SAMPLES(above), SAMPLES(y), SAMPLES(below));
+	}
+	
+	#undef PIXELS
+	#undef SAMPLES
+}
+
+/** @brief Streams `input` once, finding its highest difference and the first
+ *  place it shows up in, column by column, as highest_difference() does. */
+template<bool hue>
+u8 stream_highest(effect::row_reader& input, effect::Pixel<u8> line_color, size_t& highest_x, size_t& highest_y){
+	const size_t w = input.width();
+	const size_t h = input.height();
 	
-	// Apply effects
-	trace_boundaries(&source);
+	std::vector<u8> differences(w);
 	
-	// Write file
-	effect::write_bitmap(&source, std::string(argv[2]));
+	u8 highest = 0;
+	highest_x = 0;
+	highest_y = 0;
+	
+	stream_rows<hue>(input, line_color, [&](size_t y,
+		const effect::Pixel<u8>* above, const effect::Pixel<u8>* here, const effect::Pixel<u8>* below,
+		const u8* s_above, const u8* s_here, const u8* s_below){
+		
+		trace_row<hue, false>(above, here, below, s_above, s_here, s_below, w, y == 0, y == h - 1,
+		                      differences.data(), NULL, line_color);
+		
+		size_t x, unused;
+		u8 row_highest = highest_difference(differences.data(), w, 1, x, unused);
+		
+		// Keep the first place it shows up in, column by column
+		if(row_highest > highest || (row_highest == highest && highest != 0 && x < highest_x)){
+			highest   = row_highest;
+			highest_x = x;
+			highest_y = y;
+		}
+	});
+	
+	return highest;
+}
+
+/** @brief Finds the difference to be drawn opaque in the image read by `input`, as scale_of() does.
+ *
+ *  Only the highest difference needs the whole image streamed. Sampled and
+ *  quantile scales seek to the sampled rows, reading just the ones around
+ *  them, and fixed ones read nothing at all. */
+template<bool hue>
+u8 stream_scale(effect::row_reader& input, effect::Pixel<u8> line_color, const normalization& norm){
+	const size_t w = input.width();
+	const size_t h = input.height();
+	
+	if(norm.mode == normalization::highest){
+		// Get the hihest value
+		size_t highest_x, highest_y;
+		float highest_diff = stream_highest<hue>(input, line_color, highest_x, highest_y);
+		
+		printf("Highest diff: %f (%zu, %zu)\n", highest_diff, highest_x, highest_y);
+		return static_cast<u8>(highest_diff);
+	}
+	
+	u8 scale = norm.scale;
+	if(norm.mode != normalization::fixed){
+		const size_t stride = w * samples::planes;
+		
+		std::vector<effect::Pixel<u8>> rows(3 * w);
+		std::vector<u8>                plane(3 * stride);
+		std::vector<u8>                differences(w);
+		
+		size_t histogram[0x100] = { };
+		for(size_t y = norm.first(h); y < h; y += norm.step){
+			// Rows around this one, repeating the edges of the image
+			size_t above = y == 0     ? y : y - 1;
+			size_t below = y == h - 1 ? y : y + 1;
+			
+			input.seek(above);
+			for(size_t r = above; r <= below; ++r)
+				input.read(&rows[(r - above) * w], 1);
+			
+			const size_t count = below - above + 1;
+			for(size_t r = 0; r < count; ++r)
+				sample_row<hue>(&rows[r * w], &plane[r * stride], w, line_color);
+			
+			const size_t m = y - above, b = count - 1;
+			trace_row<hue, false>(&rows[0],     &rows[m * w],          &rows[b * w],
+			                      &plane[0],     &plane[m * stride],    &plane[b * stride],
+			                      w, y == 0, y == h - 1, differences.data(), NULL, line_color);
+			
+			for(size_t x = 0; x < w; ++x)
+				++histogram[differences[x]];
+		}
+		
+		input.restart();
+		scale = norm.of(histogram);
+	}
+	
+	printf("Scale: %u\n", scale);
+	return scale;
+}
+
+/** Traces the boundaries of the image read by `input` into `output`, as the
+ *  in-memory trace_boundaries() does, keeping no more than a few rows around.
+ *
+ *  Unless the scale is known ahead, the input is streamed twice: first to
+ *  find it, without averaging colours, then to trace every row again and
+ *  write it out as soon as it is done. */
+template<bool hue>
+void trace_boundaries(effect::row_reader& input, effect::row_writer& output, effect::Pixel<u8> line_color, const normalization& norm = normalization()){
+	const size_t w = input.width();
+	const size_t h = input.height();
+	
+	std::vector<u8>                differences(w);
+	std::vector<effect::Pixel<u8>> traced(w);
+	
+	float highest_diff = stream_scale<hue>(input, line_color, norm);
+	
+	// Get the alpha value for every 1 of difference
+	float alpha_per_diff = 0xFF / (highest_diff == 0 ? 1 : highest_diff);
+	
+	// Trace again, writing every row out once it is done
+	stream_rows<hue>(input, line_color, [&](size_t y,
+		const effect::Pixel<u8>* above, const effect::Pixel<u8>* here, const effect::Pixel<u8>* below,
+		const u8* s_above, const u8* s_here, const u8* s_below){
+		
+		trace_row<hue>(above, here, below, s_above, s_here, s_below, w, y == 0, y == h - 1,
+		               differences.data(), traced.data(), line_color);
+		write_alpha(effect::BitmapView(w, 1, traced.data()), differences.data(), alpha_per_diff);
+		
+		output.write(traced.data(), 1);
+	});
+}
+
+/** Streams the edge map of the image read by `input` into the single channel
+ *  `output`, as trace_edges() does, keeping no more than a few rows around. */
+template<bool hue>
+void trace_edges(effect::row_reader& input, effect::row_writer& output, effect::Pixel<u8> line_color,
+                 const normalization& norm = normalization(), double threshold = 0.5){
+	const size_t w = input.width();
+	const size_t h = input.height();
+	
+	edge_quantizer quantize(stream_scale<hue>(input, line_color, norm), output.format(), threshold);
+	
+	std::vector<u8> differences(w);
+	std::vector<u8> row(output.row_length());
+	
+	stream_rows<hue>(input, line_color, [&](size_t y,
+		const effect::Pixel<u8>* above, const effect::Pixel<u8>* here, const effect::Pixel<u8>* below,
+		const u8* s_above, const u8* s_here, const u8* s_below){
+		
+		trace_row<hue, false>(above, here, below, s_above, s_here, s_below, w, y == 0, y == h - 1,
+		                      differences.data(), NULL, line_color);
+		quantize(differences.data(), w, row.data());
+		
+		output.write(row.data(), 1);
+	});
+}
+
+void trace_boundaries(const effect::BitmapView& input, const effect::BitmapView& output, bool hue = false, effect::Pixel<u8> line_color = {0xFF, 0xFF, 0xFF, 0xFF}){
+	if(hue)
+		trace_boundaries<true>(input, output, line_color);
+	else
+		trace_boundaries<false>(input, output, line_color);
+}
+
+void trace_boundaries(effect::row_reader& input, effect::row_writer& output, bool hue = false, effect::Pixel<u8> line_color = {0xFF, 0xFF, 0xFF, 0xFF}, const normalization& norm = normalization()){
+	if(hue)
+		trace_boundaries<true>(input, output, line_color, norm);
+	else
+		trace_boundaries<false>(input, output, line_color, norm);
+}
+
+void trace_edges(effect::row_reader& input, effect::row_writer& output, bool hue = false, effect::Pixel<u8> line_color = {0xFF, 0xFF, 0xFF, 0xFF}, const normalization& norm = normalization(), double threshold = 0.5){
+	if(hue)
+		trace_edges<true>(input, output, line_color, norm, threshold);
+	else
+		trace_edges<false>(input, output, line_color, norm, threshold);
+}
+
+int main(int argc, char** argv){
+	struct{
+		std::string source = "";
+		std::string output = "";
+		
+		bool incomplete() { return source.empty() || output.empty(); }
+		
+		bool hue    = false;
+		bool stream = false;
+		
+		size_t edges = 0; // Bits per pixel of the edge map, 0 for RGBA output
+		
+		// Edge operator to measure differences with, instead of the tracer's own
+		bool             operate = false;
+		edges::detector  detector;
+		std::string      unknown = "";
+		
+		size_t preview = 0; // Times the image is halved before being traced
+		size_t scales  = 1; // Pyramid levels differences are averaged over
+		
+		// Outline regions at least this high a fraction of the highest difference, as text,
+		// which is also where 1-bit edge maps are set
+		bool   contours = false;
+		double level    = 0.5;
+		
+		// What the differences are scaled to, and the name it was given
+		normalization norm;
+		std::string   scaling = "";
+		
+		// Only trace again what changed since the last run, remembered next to the output
+		bool incremental = false;
+	} flags;
+	
+	for(size_t i = 1; i < argc; ++i){
+		// Parse flags
+		if(std::string(argv[i]) == "--hue" || std::string(argv[i]) == "-h")
+			flags.hue = true;
+		else if(std::string(argv[i]) == "--stream" || std::string(argv[i]) == "-s")
+			flags.stream = true;
+		else if(std::string(argv[i]) == "--incremental" || std::string(argv[i]) == "-i")
+			flags.incremental = true;
+		else if(std::string(argv[i]) == "--contours" || std::string(argv[i]) == "-c")
+			flags.contours = true;
+		else if((std::string(argv[i]) == "--level" || std::string(argv[i]) == "-l") && i + 1 < argc)
+			flags.level = std::min(1.0, std::max(0.0, atof(argv[++i]) / 100));
+		else if((std::string(argv[i]) == "--edges" || std::string(argv[i]) == "-e") && i + 1 < argc)
+			flags.edges = atoi(argv[++i]);
+		else if((std::string(argv[i]) == "--operator" || std::string(argv[i]) == "-o") && i + 1 < argc){
+			std::string name = argv[++i];
+			
+			flags.operate = true;
+			if(name == "sobel")
+				flags.detector.type = edges::sobel;
+			else if(name == "scharr")
+				flags.detector.type = edges::scharr;
+			else if(name == "canny")
+				flags.detector.type = edges::canny;
+			else
+				flags.unknown = name;
+		}else if((std::string(argv[i]) == "--normalize" || std::string(argv[i]) == "-n") && i + 1 < argc){
+			std::string name = argv[++i];
+			
+			if(name == "highest")
+				flags.norm.mode = normalization::highest;
+			else if(name == "fixed")
+				flags.norm.mode = normalization::fixed;
+			else if(name == "sampled")
+				flags.norm.mode = normalization::sampled;
+			else if(name == "quantile")
+				flags.norm.mode = normalization::quantile;
+			else
+				flags.scaling = name;
+		}else if(std::string(argv[i]) == "--scale" && i + 1 < argc)
+			flags.norm.scale = static_cast<u8>(std::min(0xFF, std::max(0, atoi(argv[++i]))));
+		else if(std::string(argv[i]) == "--step" && i + 1 < argc)
+			flags.norm.step = std::max(1, atoi(argv[++i]));
+		else if(std::string(argv[i]) == "--quantile" && i + 1 < argc)
+			flags.norm.q = std::min(1.0, std::max(0.0, atof(argv[++i]) / 100));
+		else if((std::string(argv[i]) == "--preview" || std::string(argv[i]) == "-p") && i + 1 < argc)
+			flags.preview = atoi(argv[++i]);
+		else if((std::string(argv[i]) == "--scales" || std::string(argv[i]) == "-m") && i + 1 < argc)
+			flags.scales = atoi(argv[++i]);
+		else if((std::string(argv[i]) == "--thresholds" || std::string(argv[i]) == "-t") && i + 2 < argc){
+			flags.detector.low  = std::min(1.0, std::max(0.0, atof(argv[++i]) / 100));
+			flags.detector.high = std::min(1.0, std::max(0.0, atof(argv[++i]) / 100));
+		}else{
+			// Parse default arguments
+			if(flags.source.empty())
+				flags.source = argv[i];
+			else if(flags.output.empty())
+				flags.output = argv[i];
+		}
+	}
+	
+	if(flags.incomplete() || (flags.edges != 0 && flags.edges != 1 && flags.edges != 8 && flags.edges != 16) || flags.scales == 0){
+		fprintf(stderr, "Usage: %s [--hue] [--stream] [--incremental] [--edges <1|8|16>] [--operator <sobel|scharr|canny>] [--thresholds <Low %%> <High %%>] [--preview <Halvings>] [--scales <Levels>] [--contours] [--level <Percent>] [--normalize <highest|fixed|sampled|quantile>] [--scale <Difference>] [--step <Rows>] [--quantile <Percent>] <Input> <Output>\n", argv[0]);
+		return 3;
+	}
+	
+	if(!flags.unknown.empty()){
+		fprintf(stderr, "Unknown edge operator \"%s\".\n", flags.unknown.c_str());
+		return 3;
+	}
+	
+	if(!flags.scaling.empty()){
+		fprintf(stderr, "Unknown normalization \"%s\".\n", flags.scaling.c_str());
+		return 3;
+	}
+	
+	if(flags.stream && (flags.operate || flags.preview != 0 || flags.scales != 1 || flags.contours)){
+		fprintf(stderr, "Edge operators, pyramids and contours need the whole image, they cannot be streamed.\n");
+		return 3;
+	}
+	
+	if(flags.incremental && (flags.stream || flags.operate || flags.preview != 0 || flags.scales != 1)){
+		fprintf(stderr, "Only the tracer's own differences, over the whole image, can be traced incrementally.\n");
+		return 3;
+	}
+	
+	try{
+		// Write the edge strength alone, as a single channel
+		u64 format = flags.edges == 1 ? GLT_PIXEL_FORMAT_R1 :
+		             flags.edges == 8 ? GLT_PIXEL_FORMAT_R8 : GLT_PIXEL_FORMAT_R16;
+		
+		// Tile cache left next to the output by incremental runs, which any other run writes over
+		const std::string cache = flags.output + ".tiles";
+		if(!flags.incremental)
+			remove(cache.c_str());
+		
+		if(flags.stream){
+			// Rows are read as they are written, so the input cannot be the output
+			if(effect::same_file(flags.source, flags.output)){
+				fprintf(stderr, "Output file must not be the input file.\n");
+				return 1;
+			}
+			
+			// Stream the image through, a few rows at a time
+			effect::row_reader input(flags.source);
+			
+			if(flags.edges != 0){
+				effect::row_writer output(flags.output, input.width(), input.height(), format);
+				trace_edges(input, output, flags.hue, {0xFF, 0xFF, 0xFF, 0xFF}, flags.norm, flags.level);
+				output.close();
+			}else{
+				effect::row_writer output(flags.output, input.width(), input.height());
+				trace_boundaries(input, output, flags.hue, {0xFF, 0xFF, 0xFF, 0xFF}, flags.norm);
+				output.close();
+			}
+			
+			return 0;
+		}
+		
+		// Load the texture into a bitmap
+		effect::Bitmap source = effect::load_bitmap(flags.source);
+		
+		// Halve it down for a preview, then further for every other scale to trace at
+		std::vector<effect::Bitmap> reduced = pyramid::reduce(source, flags.preview + flags.scales - 1);
+		
+		std::vector<effect::BitmapView> levels;
+		for(size_t l = flags.preview; l < flags.preview + flags.scales; ++l)
+			levels.push_back(l == 0 ? source.view() : reduced[l - 1].view());
+		
+		const effect::BitmapView& input = levels[0];
+		
+		metric m;
+		m.hue      = flags.hue;
+		m.operate  = flags.operate;
+		m.detector = flags.detector;
+		
+		std::vector<u8> differences(input.length());
+		
+		// Everything the output is written with, besides the differences, for the tile cache to be left with
+		u64 settings = 0xCBF29CE484222325;
+		for(u64 v : { (u64) flags.edges, (u64) flags.contours, (u64) flags.operate, (u64) flags.detector.type,
+		              (u64) flags.norm.mode, (u64) flags.norm.scale, (u64) flags.norm.step })
+			settings = tiles::fold(settings, v);
+		for(double v : { flags.detector.low, flags.detector.high, flags.norm.q, flags.level })
+			settings = tiles::fold(settings, v);
+		
+		tiles::cache changes;
+		
+		if(flags.contours){
+			if(flags.incremental)
+				changes = measure_changes(input, effect::BitmapView(), true, differences.data(), m, cache, settings, "");
+			else
+				measure(levels, effect::BitmapView(), differences.data(), m);
+			
+			write_contours(differences.data(), input.width, input.height, flags.level, flags.output, flags.norm);
+		}else if(flags.edges != 0){
+			effect::row_writer output(flags.output, input.width, input.height, format);
+			
+			if(flags.incremental)
+				changes = measure_changes(input, effect::BitmapView(), true, differences.data(), m, cache, settings, "");
+			else
+				measure(levels, effect::BitmapView(), differences.data(), m);
+			
+			write_edges(differences.data(), input.width, input.height, output, flags.norm, flags.level);
+			output.close();
+		}else{
+			// Map the output file, the traced boundaries are written straight into it. Incremental runs keep
+			// the colours left in it by the last one, if it is still there.
+			effect::Bitmap output;
+			if(flags.incremental)
+				output = effect::reopen_bitmap(flags.output, input.width, input.height);
+			
+			const bool kept = output.data != NULL;
+			if(!kept)
+				output = effect::map_bitmap(flags.output, input.width, input.height);
+			
+			if(flags.incremental)
+				changes = measure_changes(input, output, kept, differences.data(), m, cache, settings, flags.output);
+			else
+				measure(levels, output, differences.data(), m);
+			
+			write_boundaries(differences.data(), output, flags.norm);
+		}
+		
+		// Only once the output is closed, for the cache to know it as it was left
+		if(flags.incremental)
+			changes.save(cache, flags.output);
+	}catch(const std::exception& e){
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
 }
@@ -0,0 +1,193 @@
+#ifndef __AES_H__
+#define __AES_H__
+
+#include "effect.hh"
+
+#include <string> // For std::string
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_HARDWARE
+#include <wmmintrin.h> // For _mm_aesenc_si128() and _mm_aesenclast_si128()
+#endif
+
+/** AES-128 encryption, through AES-NI where the processor has it, and in
+ *  software everywhere else. Both give the same blocks, so anything derived
+ *  from them is the same on every machine. Only encryption is needed, as
+ *  keystreams are only ever encrypted counters. */
+namespace aes{
+	static const size_t block  = 16;
+	static const size_t rounds = 10;
+
+	/** The key of every round, the first being the key itself. */
+	struct round_keys{
+		u8 bytes[(rounds + 1) * block] = { };
+	};
+
+	static const u8 sbox[256] = {
+		0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+		0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+		0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+		0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+		0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+		0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+		0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+		0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+		0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+		0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+		0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+		0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+		0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+		0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+		0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+		0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+	};
+
+	/** @brief Multiplies `x` by 2 in GF(2^8). */
+	inline u8 xtime(u8 x){
+		return static_cast<u8>((x << 1) ^ ((x >> 7) * 0x1B));
+	}
+
+	/** @brief Expands a 16-byte `key` into the keys of every round. */
+	round_keys expand(const u8* key){
+		round_keys k;
+		memcpy(k.bytes, key, block);
+
+		u8 rcon = 0x01;
+		for(size_t i = block; i < sizeof(k.bytes); i += 4){
+			u8 t[4] = { k.bytes[i - 4], k.bytes[i - 3], k.bytes[i - 2], k.bytes[i - 1] };
+
+			if(i % block == 0){
+				// Rotate, substitute, and add the round constant
+				u8 first = t[0];
+				t[0] = sbox[t[1]] ^ rcon;
+				t[1] = sbox[t[2]];
+				t[2] = sbox[t[3]];
+				t[3] = sbox[first];
+
+				rcon = xtime(rcon);
+			}
+
+			for(size_t j = 0; j < 4; ++j)
+				k.bytes[i + j] = k.bytes[i + j - block] ^ t[j];
+		}
+
+		return k;
+	}
+
+	/** @brief Encrypts `count` blocks from `in` into `out`, a byte at a time. */
+	void encrypt_software(const round_keys& k, const u8* in, u8* out, size_t count){
+		for(size_t b = 0; b < count; ++b){
+			u8 s[block];
+			for(size_t i = 0; i < block; ++i)
+				s[i] = in[b * block + i] ^ k.bytes[i];
+
+			for(size_t r = 1; r <= rounds; ++r){
+				// Substitute and shift rows, the state being column by column
+				u8 t[block];
+				for(size_t c = 0; c < 4; ++c)
+					for(size_t row = 0; row < 4; ++row)
+						t[c * 4 + row] = sbox[s[((c + row) % 4) * 4 + row]];
+
+				// Mix columns, but for the last round
+				for(size_t c = 0; c < 4 && r != rounds; ++c){
+					u8 *col = &t[c * 4];
+					u8  all = col[0] ^ col[1] ^ col[2] ^ col[3];
+					u8  a0  = col[0];
+
+					col[0] ^= all ^ xtime(col[0] ^ col[1]);
+					col[1] ^= all ^ xtime(col[1] ^ col[2]);
+					col[2] ^= all ^ xtime(col[2] ^ col[3]);
+					col[3] ^= all ^ xtime(col[3] ^ a0);
+				}
+
+				for(size_t i = 0; i < block; ++i)
+					s[i] = t[i] ^ k.bytes[r * block + i];
+			}
+
+			memcpy(&out[b * block], s, block);
+		}
+	}
+
+	#ifdef AES_HARDWARE
+	/** @brief Encrypts `count` blocks from `in` into `out` with AES-NI, eight at a time, to keep its pipeline full. */
+	__attribute__((target("aes,sse2")))
+	void encrypt_hardware(const round_keys& k, const u8* in, u8* out, size_t count){
+		__m128i keys[rounds + 1];
+		for(size_t r = 0; r <= rounds; ++r)
+			keys[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&k.bytes[r * block]));
+
+		const __m128i *source = reinterpret_cast<const __m128i*>(in);
+		__m128i       *dest   = reinterpret_cast<__m128i*>(out);
+
+		for(; count >= 8; count -= 8, source += 8, dest += 8){
+			__m128i s[8];
+			#pragma GCC unroll 8
+			for(size_t i = 0; i < 8; ++i)
+				s[i] = _mm_xor_si128(_mm_loadu_si128(&source[i]), keys[0]);
+
+			for(size_t r = 1; r < rounds; ++r){
+				#pragma GCC unroll 8
+				for(size_t i = 0; i < 8; ++i)
+					s[i] = _mm_aesenc_si128(s[i], keys[r]);
+			}
+
+			#pragma GCC unroll 8
+			for(size_t i = 0; i < 8; ++i)
+				_mm_storeu_si128(&dest[i], _mm_aesenclast_si128(s[i], keys[rounds]));
+		}
+
+		for(; count > 0; --count, ++source, ++dest){
+			__m128i s = _mm_xor_si128(_mm_loadu_si128(source), keys[0]);
+
+			for(size_t r = 1; r < rounds; ++r)
+				s = _mm_aesenc_si128(s, keys[r]);
+
+			_mm_storeu_si128(dest, _mm_aesenclast_si128(s, keys[rounds]));
+		}
+	}
+	#endif
+
+	/** @brief Encrypts `count` blocks from `in` into `out`, with AES-NI if the processor has it. */
+	void encrypt(const round_keys& k, const u8* in, u8* out, size_t count){
+		#ifdef AES_HARDWARE
+		static const bool hardware = __builtin_cpu_supports("aes");
+		if(hardware){
+			encrypt_hardware(k, in, out, count);
+			return;
+		}
+		#endif
+
+		encrypt_software(k, in, out, count);
+	}
+
+	/** @brief Hashes `data` into a 16-byte key, with AES in a Davies-Meyer construction.
+	 *
+	 *  Every 16 bytes of the data, padded with a one bit and its length as
+	 *  Merkle-Damgard padding goes, key an encryption of the hash so far,
+	 *  which is then added back to it. */
+	void digest(const std::string& data, u8* hash){
+		std::string padded = data;
+		padded.push_back(static_cast<char>(0x80));
+		while(padded.size() % block != block - 8)
+			padded.push_back(0);
+
+		u64 bits = static_cast<u64>(data.size()) * 8;
+		for(size_t i = 0; i < 8; ++i)
+			padded.push_back(static_cast<char>(bits >> (i * 8)));
+
+		u8 h[block] = { };
+		for(size_t i = 0; i < padded.size(); i += block){
+			round_keys k = expand(reinterpret_cast<const u8*>(&padded[i]));
+
+			u8 e[block];
+			encrypt(k, h, e, 1);
+
+			for(size_t j = 0; j < block; ++j)
+				h[j] ^= e[j];
+		}
+
+		memcpy(hash, h, block);
+	}
+}
+
+#endif // __AES_H__
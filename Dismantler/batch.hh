@@ -0,0 +1,224 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "cache.hh"
+
+#include <string>    // For std::string
+#include <vector>    // For std::vector
+#include <algorithm> // For std::stable_sort()
+#include <stdexcept> // For std::runtime_error
+
+#include <dirent.h>   // For opendir() and readdir()
+#include <limits.h>   // For PATH_MAX
+#include <stdlib.h>   // For realpath()
+#include <sys/stat.h> // For mkdir() and stat()
+
+#ifdef _OPENMP
+#include <omp.h> // For omp_get_max_threads()
+#endif
+
+/** Many images run through the Dismantler in one go, with the same key.
+ *
+ *  The key is set up once for every image. Images are grouped by size, as
+ *  images of the same size share the same opcodes, then the group's images
+ *  are run a few at a time. Opcodes are only shared through the schedule
+ *  cache: with one, a size's opcodes are mapped in once for its whole
+ *  group, and without one, every image derives its own as it is run. Only
+ *  as many images as are run at once, and the opcodes of one size, are
+ *  ever held, however many images there are. */
+namespace batch{
+	struct job{
+		std::string input;
+		std::string output;
+
+		size_t width  = 0;
+		size_t height = 0;
+	};
+
+	/** @brief Whether `path` is a directory, rather than a manifest. */
+	bool is_directory(const std::string& path){
+		struct stat info;
+		return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+	}
+
+	/** @brief Jobs for every GLT file in `source`, written under the same names in `output`.
+	 *
+	 *  `output` is created if it does not exist. Throws std::runtime_error if
+	 *  either directory cannot be used, or if both are the same one, as every
+	 *  output is truncated before its input is read. */
+	std::vector<job> directory(const std::string& source, const std::string& output){
+		mkdir(output.c_str(), 0755);
+
+		char from[PATH_MAX], to[PATH_MAX];
+		if(realpath(source.c_str(), from) == NULL || realpath(output.c_str(), to) == NULL)
+			throw std::runtime_error("Could not open input or output directory.");
+		if(std::string(from) == std::string(to))
+			throw std::runtime_error("Input and output directories must not be the same.");
+
+		DIR *dir = opendir(source.c_str());
+		if(dir == NULL)
+			throw std::runtime_error("Could not open input directory.");
+
+		std::vector<std::string> names;
+		for(struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)){
+			std::string name = entry->d_name;
+			if(name.size() > 4 && name.compare(name.size() - 4, 4, ".glt") == 0)
+				names.push_back(name);
+		}
+
+		closedir(dir);
+
+		// Listed in no particular order, so put them in one
+		std::sort(names.begin(), names.end());
+
+		std::vector<job> jobs(names.size());
+		for(size_t i = 0; i < names.size(); ++i){
+			jobs[i].input  = source + "/" + names[i];
+			jobs[i].output = output + "/" + names[i];
+		}
+
+		return jobs;
+	}
+
+	/** @brief Jobs listed in the manifest at `path`, a line per image, its input and output separated by a tab.
+	 *
+	 *  Empty lines, and lines starting with '#', are skipped. Throws
+	 *  std::runtime_error if the manifest cannot be read, or a line has no
+	 *  output. */
+	std::vector<job> manifest(const std::string& path){
+		FILE *file = fopen(path.c_str(), "r");
+		if(file == NULL)
+			throw std::runtime_error("Could not open manifest file.");
+
+		std::vector<job> jobs;
+		std::string      line;
+		size_t           number = 0;
+
+		for(int c = fgetc(file); c != EOF || !line.empty(); c = fgetc(file)){
+			if(c != '\n' && c != EOF){
+				line.push_back(static_cast<char>(c));
+				continue;
+			}
+
+			++number;
+			if(!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			if(!line.empty() && line[0] != '#'){
+				size_t tab = line.find('\t');
+				if(tab == std::string::npos || tab == 0 || tab + 1 == line.size()){
+					fclose(file);
+					throw std::runtime_error("Line " + std::to_string(number) + " of the manifest has no output.");
+				}
+
+				job j;
+				j.input  = line.substr(0, tab);
+				j.output = line.substr(tab + 1);
+				jobs.push_back(j);
+			}
+
+			line.clear();
+			if(c == EOF)
+				break;
+		}
+
+		fclose(file);
+		return jobs;
+	}
+
+	/** @brief Runs `apply` over every job, `concurrent` images at a time, returning how many failed.
+	 *
+	 *  `apply` is given every image, along with the opcodes of the schedule
+	 *  over the whole of it, or NULL for them to be derived as it is run.
+	 *  Jobs are sorted by the size of their input, read from its header. With
+	 *  a `cache` directory, every size's opcodes are taken from it. Without
+	 *  one, nothing is shared between images: every image derives them as
+	 *  it is run, through the schedule, which takes the same memory for any
+	 *  size of image. Tiled schemes have no opcodes to share, their tiles
+	 *  each having keys of their own. Images that cannot be read or written are reported, and
+	 *  skipped. Any number of OpenMP threads are run at once if `concurrent`
+	 *  is 0. */
+	template<typename Generator, typename Effect>
+	size_t run(std::vector<job>& jobs, const fragment::key<Generator>& key, size_t complexity, size_t scheme, const std::string& cache, size_t concurrent, Effect apply){
+		size_t failed = 0;
+
+		#ifdef _OPENMP
+		if(concurrent == 0)
+			concurrent = omp_get_max_threads();
+		#endif
+		if(concurrent == 0)
+			concurrent = 1;
+
+		// Size every input up front, dropping the ones that cannot be read
+		std::vector<job> sized;
+		for(job& j : jobs){
+			try{
+				glt::texture_header header;
+				fclose(effect::open_bitmap(j.input, header));
+
+				j.width  = header.width;
+				j.height = header.height;
+				sized.push_back(j);
+			}catch(const std::exception& e){
+				fprintf(stderr, "%s\n", e.what());
+				++failed;
+			}
+		}
+
+		std::stable_sort(sized.begin(), sized.end(), [](const job& a, const job& b){
+			return a.width != b.width ? a.width < b.width : a.height < b.height;
+		});
+
+		for(size_t first = 0, last; first < sized.size(); first = last){
+			last = first;
+			while(last < sized.size() && sized[last].width == sized[first].width && sized[last].height == sized[first].height)
+				++last;
+
+			// A schedule of the group's size, with no pixels, to derive opcodes from
+			fragment::pixel_block shape = {
+				0, 0,
+				sized[first].width, sized[first].height,
+
+				sized[first].width, sized[first].height,
+				NULL
+			};
+			fragment::schedule<Generator> group(key, shape);
+
+			cache::mapping mapped;
+			const u8      *opcodes = NULL;
+
+			try{
+				if(!cache.empty() && !fragment::tiled(scheme)){
+					mapped  = cache::open(cache, group, complexity, scheme);
+					opcodes = mapped.opcodes();
+				}
+			}catch(const std::exception& e){
+				fprintf(stderr, "%s\n", e.what());
+
+				failed += last - first;
+				continue;
+			}
+
+			// Within a lone image, operations are still run in parallel
+			const size_t threads = std::min(concurrent, last - first);
+
+			#pragma omp parallel for schedule(dynamic) num_threads(threads) reduction(+:failed)
+			for(size_t i = first; i < last; ++i){
+				try{
+					// The output file is mapped and filled with the input's pixels,
+					// so operations are applied in place, directly onto the output.
+					effect::Bitmap image = effect::map_bitmap(sized[i].output, sized[i].input);
+
+					apply(image.view(), opcodes);
+				}catch(const std::exception& e){
+					fprintf(stderr, "%s: %s\n", sized[i].input.c_str(), e.what());
+					++failed;
+				}
+			}
+		}
+
+		return failed;
+	}
+}
+
+#endif // __BATCH_H__
@@ -0,0 +1,198 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "fragment.hh"
+
+#include <string>    // For std::string
+#include <stdexcept> // For std::runtime_error
+
+#include <fcntl.h>    // For open()
+#include <sys/mman.h> // For mmap() and munmap()
+#include <unistd.h>   // For close(), pread(), ftruncate() and getpid()
+
+/** Schedules kept on disk, so runs over images of the same size, with the
+ *  same key, take their opcodes from a file instead of deriving them again.
+ *
+ *  A file starts with a header, followed by the opcodes of every operation,
+ *  in the order schedule::at() numbers them. It is written in the machine's
+ *  own byte order, and is only ever a cache: a file that is missing, was
+ *  left by another machine, or does not match the schedule is written
+ *  again. Anyone who can read the file can remantle with it, without the
+ *  key, so it is only readable by its owner. */
+namespace cache{
+	struct header{
+		char magic[4] = { 'G', 'L', 'T', 'S' };
+		u32  version  = 1;
+
+		u64 identity   = 0;
+		u64 width      = 0;
+		u64 height     = 0;
+		u64 operations = 0;
+		u64 length     = 0; // Opcodes per operation
+	};
+
+	/** @brief Identity of a schedule, run at `complexity`, with version `scheme` of the Dismantler. */
+	template<typename Generator>
+	u64 identity(const fragment::schedule<Generator>& schedule, size_t complexity, size_t scheme){
+		return fragment::mix(fragment::mix(schedule.identity() ^ complexity) ^ scheme);
+	}
+
+	/** @brief Path of the file in `directory` holding the schedule with `identity`. */
+	std::string path(const std::string& directory, u64 identity){
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.schedule", (unsigned long long) identity);
+
+		return directory + "/" + name;
+	}
+
+	/** A mapped schedule file, unmapped when destroyed. Can only be moved. */
+	class mapping{
+	private:
+		void   *_data   = NULL;
+		size_t  _length = 0;
+
+	public:
+		mapping() { }
+
+		mapping(void* data, size_t length) : _data(data), _length(length) { }
+
+		mapping(mapping&& other){
+			*this = std::move(other);
+		}
+
+		mapping& operator=(mapping&& other){
+			if(this != &other){
+				if(_data != NULL)
+					munmap(_data, _length);
+
+				_data   = other._data;
+				_length = other._length;
+
+				other._data   = NULL;
+				other._length = 0;
+			}
+
+			return *this;
+		}
+
+		mapping(const mapping&) = delete;
+		mapping& operator=(const mapping&) = delete;
+
+		~mapping(){
+			if(_data != NULL)
+				munmap(_data, _length);
+		}
+
+		/** @brief Whether nothing is mapped. */
+		bool empty() const{
+			return _data == NULL;
+		}
+
+		/** @brief Opcodes of every operation, as schedule::use() takes them. */
+		const u8* opcodes() const{
+			return static_cast<const u8*>(_data) + sizeof(header);
+		}
+	};
+
+	/** @brief Derives the opcodes of every operation of `schedule` into `opcodes`, in parallel. */
+	template<typename Generator>
+	void derive(const fragment::schedule<Generator>& schedule, u8* opcodes){
+		const size_t length = schedule.length();
+
+		#pragma omp parallel
+		{
+			std::vector<u8> code;
+
+			#pragma omp for schedule(static)
+			for(size_t i = 0; i < schedule.size(); ++i){
+				schedule.opcodes(schedule[i], code);
+				memcpy(&opcodes[i * length], code.data(), length);
+			}
+		}
+	}
+
+	/** @brief Maps the file at `path`, returning an empty mapping if there is none, it is not whole, or it does not hold `expected`. */
+	mapping load(const std::string& path, const header& expected){
+		int file = ::open(path.c_str(), O_RDONLY);
+		if(file < 0)
+			return mapping();
+
+		const size_t length = sizeof(header) + expected.operations * expected.length;
+
+		header info;
+		off_t  end = lseek(file, 0, SEEK_END);
+
+		bool whole = pread(file, &info, sizeof(header), 0) == sizeof(header) &&
+		             memcmp(&info, &expected, sizeof(header)) == 0 &&
+		             end >= 0 && static_cast<size_t>(end) == length;
+
+		if(!whole){
+			close(file);
+			return mapping();
+		}
+
+		void *data = mmap(NULL, length, PROT_READ, MAP_SHARED, file, 0);
+		close(file);
+
+		if(data == MAP_FAILED)
+			return mapping();
+
+		return mapping(data, length);
+	}
+
+	/** @brief Maps the schedule file for `schedule` from `directory`, writing it first if load() finds none.
+	 *
+	 *  Opcodes are derived into the mapping of a new file, in parallel, which
+	 *  then takes the place of the old one, so runs sharing the directory
+	 *  never see a file half written. Throws std::runtime_error if the file
+	 *  cannot be written. */
+	template<typename Generator>
+	mapping open(const std::string& directory, const fragment::schedule<Generator>& schedule, size_t complexity, size_t scheme){
+		header expected;
+		expected.identity   = identity(schedule, complexity, scheme);
+		expected.width      = schedule.width();
+		expected.height     = schedule.height();
+		expected.operations = schedule.size();
+		expected.length     = schedule.length();
+
+		const std::string target = path(directory, expected.identity);
+
+		mapping cached = load(target, expected);
+		if(!cached.empty())
+			return cached;
+
+		const std::string written = target + "." + std::to_string(getpid());
+		const size_t      length  = sizeof(header) + expected.operations * expected.length;
+
+		int file = ::open(written.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if(file < 0)
+			throw std::runtime_error("Could not open schedule cache file.");
+
+		if(ftruncate(file, length) != 0){
+			close(file);
+			unlink(written.c_str());
+			throw std::runtime_error("Could not allocate space for the schedule cache file.");
+		}
+
+		void *data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		close(file);
+
+		if(data == MAP_FAILED){
+			unlink(written.c_str());
+			throw std::runtime_error("Could not map the schedule cache file.");
+		}
+
+		memcpy(data, &expected, sizeof(header));
+		derive(schedule, static_cast<u8*>(data) + sizeof(header));
+
+		if(rename(written.c_str(), target.c_str()) != 0){
+			munmap(data, length);
+			unlink(written.c_str());
+			throw std::runtime_error("Could not write schedule cache file.");
+		}
+
+		return mapping(data, length);
+	}
+}
+
+#endif // __CACHE_H__
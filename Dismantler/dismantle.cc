@@ -1,133 +1,22 @@
-#include "fragment.hh"
+#include "batch.hh"
+#include "scramble.hh"
 #include <iostream>
 				
-void swap(fragment::pixel_block& block, size_t ox1, size_t oy1, size_t ox2, size_t oy2){ 
-	
-	fragment::pixel_block block1 = block.subblock(ox1, oy1);
-	fragment::pixel_block block2 = block.subblock(ox2, oy2);
-	
-	fragment::pixel_block tmp = {
-		0, 0,
-		block2.width, block2.height,
-		
-		block2.width, block2.height,
-		(effect::Pixel<u8>*) malloc(block2.width * block2.height * sizeof(effect::Pixel<u8>))
-	};
-	
-	fragment::pixel_block::copy(tmp,    block2);
-	fragment::pixel_block::copy(block2, block1);
-	fragment::pixel_block::copy(block1, tmp);
-	
-	free(tmp.data);
-}
-
-template<typename Generator>
-void color_shift(fragment::pixel_block& block, size_t ox1, size_t oy1, size_t ox2, size_t oy2){
-	fragment::pixel_block block1 = block.subblock(ox1, oy1);
-	fragment::pixel_block block2 = block.subblock(ox2, oy2);
-	
-	size_t width  = std::min(block1.width,  block2.width);
-	size_t height = std::min(block1.height, block2.height);
-	
-	Generator rnd;
-	fragment::distribution color_dist(0x0, 0xFF);
-	fragment::distribution direction_dist(0, 1);
-	
-	//printf("Applying color shift between subblocks (%zu, %zu) and (%zu, %zu) of block {%zu, %zu, %zu, %zu}\n", ox1, oy1, ox2, oy2, block.x, block.y, block.width, block.height);
-	
-	#pragma omp parallel for collapse(2)
-	for(size_t x = 0; x < width; ++x){
-		for(size_t y = 0; y < height; ++y){
-			size_t salt = (width * height) * ((x + 1) * (y + 1)) + ox1 - oy2 + oy1 + ox2;
-			
-			effect::Pixel<u8> shift;
-			
-			rnd.seed(salt);
-			size_t direction = direction_dist(rnd);
-			if(direction){
-				// Seed: Block2
-				// Dest: Block1
-				effect::Pixel<u8> *dest = block1.at(x, y);
-				#define s(c) \
-					rnd.seed(salt * (block2.at(x, y)->c ? block2.at(x, y)->c : 1)); \
-					dest->c += color_dist(rnd);
-				
-				s(red);
-				s(green);
-				s(blue);
-				s(alpha);
-				
-				#undef s
-				
-			}else{
-				// Seed: Block1
-				// Dest: Block2
-				effect::Pixel<u8> *dest = block2.at(x, y);
-				#define s(c) \
-					rnd.seed(salt * (block1.at(x, y)->c ? block1.at(x, y)->c : 1)); \
-					dest->c += color_dist(rnd);
-				
-				s(red);
-				s(green);
-				s(blue);
-				s(alpha);
-				
-				#undef s
-			}
-		}
-	}
-}
-
-template <typename G1, typename G2 = G1>
-void apply_effect(fragment::key<G1>& key, effect::Bitmap& source){
-	// Divide the image into multiple sizes of 2 x 2 blocks, and calculate
-	// the operations in that formatq
-	fragment::pixel_block block = {
-		0, 0, 
-		source.width, source.height, 
-		
-		source.width, source.height,
-		source.data
-	};
-	
-	std::vector<fragment::operation> operations = fragment::block_operations<G1>(key, block);
-	
-	// Run operations
-	for(fragment::operation op : operations){
-		for(size_t mangled_opcode : op.code){
-			// Get current opcode
-			size_t opcode = op.opcode_table[mangled_opcode];
-			
-			switch(opcode){
-				// Position swap
-				case 0x0: swap(op.block, 0, 0, 1, 0); break; // Top-left    <=> Top-right
-				case 0x1: swap(op.block, 0, 1, 1, 1); break; // Bottom-left <=> Bottom-right
-				case 0x2: swap(op.block, 0, 0, 0, 1); break; // Top-left    <=> Bottom-left
-				case 0x3: swap(op.block, 1, 0, 1, 1); break; // Top-right   <=> Bottom-right
-				case 0x4: swap(op.block, 0, 0, 1, 1); break; // Top-left    <=> Bottom-right
-				case 0x5: swap(op.block, 0, 1, 1, 0); break; // Bottom-left <=> Top-right
-				
-				// Color shift
-				case 0x6: color_shift<G2>(op.block, 0, 0, 1, 0); break; // Top-left    <=> Top-right
-				case 0x7: color_shift<G2>(op.block, 0, 1, 1, 1); break; // Bottom-left <=> Bottom-right
-				case 0x8: color_shift<G2>(op.block, 0, 0, 0, 1); break; // Top-left    <=> Bottom-left
-				case 0x9: color_shift<G2>(op.block, 1, 0, 1, 1); break; // Top-right   <=> Bottom-right
-				case 0xA: color_shift<G2>(op.block, 0, 0, 1, 1); break; // Top-left    <=> Bottom-right
-				case 0xB: color_shift<G2>(op.block, 0, 1, 1, 0); break; // Bottom-left <=> Top-right
-			}
-		}
-	}
-}
-
 int main(int argc, char** argv){
 	struct{
 		std::string source = "";
 		std::string key    = "";
 		std::string output = "";
 		
-		bool incomplete() { return source.empty() || key.empty() || output.empty(); }
+		bool incomplete() { return source.empty() || key.empty() || (output.empty() && !batch); }
 		
 		size_t complexity = 1;
+		size_t scheme     = fragment::default_scheme;
+		
+		std::string cache = ""; // Directory of the schedule cache
+		
+		bool   batch = false;
+		size_t jobs  = 0; // Images run at once, 0 for one per thread
 	} flags;
 	
 	for(size_t i = 1; i < argc; ++i){
@@ -136,6 +25,16 @@ int main(int argc, char** argv){
 			flags.complexity = 0;
 		else if(std::string(argv[i]) == "--complex" || std::string(argv[i]) == "-c")
 			flags.complexity = 2;
+		else if(std::string(argv[i]) == "--complexity" && i + 1 < argc)
+			flags.complexity = atoi(argv[++i]);
+		else if((std::string(argv[i]) == "--scheme" || std::string(argv[i]) == "-s") && i + 1 < argc)
+			flags.scheme = atoi(argv[++i]);
+		else if(std::string(argv[i]) == "--cache" && i + 1 < argc)
+			flags.cache = argv[++i];
+		else if(std::string(argv[i]) == "--batch" || std::string(argv[i]) == "-b")
+			flags.batch = true;
+		else if((std::string(argv[i]) == "--jobs" || std::string(argv[i]) == "-j") && i + 1 < argc)
+			flags.jobs = atoi(argv[++i]);
 		else{
 			// Parse default arguments
 			if(flags.source.empty())
@@ -150,23 +49,41 @@ int main(int argc, char** argv){
 		}
 	}
 	
-	if(flags.incomplete()){
-		fprintf(stderr, "Usage: %s <Input> <Key> <Output>\n", argv[0]);
+	if(flags.incomplete() || flags.scheme < 1 || flags.scheme > fragment::scheme_version || flags.complexity > 3){
+		fprintf(stderr, "Usage: %s [--fast | --complex | --complexity <0-3>] [--scheme <1-%zu>] [--cache <Directory>] <Input> <Key> <Output>\n", argv[0], fragment::scheme_version);
+		fprintf(stderr, "       %s [...] --batch [--jobs <Images>] <Input directory> <Key> <Output directory>\n", argv[0]);
+		fprintf(stderr, "       %s [...] --batch [--jobs <Images>] <Manifest> <Key>\n", argv[0]);
 		return 3;
 	}
 	
-	#define run(generator1, generator2)\
-		glt::file source_image(flags.source.c_str()); \
-		fragment::key<generator1> key(flags.key); \
-		\
-		effect::Bitmap source; \
-		source.width  = source_image.get_texture_header().width; \
-		source.height = source_image.get_texture_header().height; \
-		source.data   = (effect::Pixel<u8>*) source_image.get_texture_data(); \
-		\
-		apply_effect<generator1, generator2>(key, source); \
+	// Every image is a job, all of them run with the same key
+	std::vector<batch::job> jobs;
+	try{
+		if(!flags.batch){
+			jobs.resize(1);
+			jobs[0].input  = flags.source;
+			jobs[0].output = flags.output;
+		}else if(batch::is_directory(flags.source)){
+			if(flags.output.empty()){
+				fprintf(stderr, "Batches of directories need an output directory.\n");
+				return 3;
+			}
+			
+			jobs = batch::directory(flags.source, flags.output);
+		}else
+			jobs = batch::manifest(flags.source);
+	}catch(const std::exception& e){
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+	
+	size_t failed = 0;
+	
+	#define run(g1, g2) \
+		fragment::key<g1> key(flags.key); \
 		\
-		effect::write_bitmap(&source, flags.output)
+		failed = batch::run(jobs, key, flags.complexity, flags.scheme, flags.cache, flags.jobs, \
+			[&](const effect::BitmapView& image, const u8* opcodes){ scramble::apply_image<g1, g2>(key, image, opcodes, flags.scheme, false); })
 	
 	if(flags.complexity == 0){
 		run(fragment::light_random_generator, fragment::light_random_generator);
@@ -174,7 +91,11 @@ int main(int argc, char** argv){
 		run(fragment::heavy_random_generator, fragment::light_random_generator);
 	}else if(flags.complexity == 2){
 		run(fragment::heavy_random_generator, fragment::heavy_random_generator);
+	}else if(flags.complexity == 3){
+		run(fragment::secure_random_generator, fragment::secure_random_generator);
 	}
 	
 	#undef run
+	
+	return failed == 0 ? 0 : 1;
 }
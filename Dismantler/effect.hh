@@ -1,8 +1,20 @@
+#ifndef __EFFECT_H__
+#define __EFFECT_H__
+
 #include "glt/glt.hpp" // For texture handling
 #include <memory.h>    // For memory-related operations
 #include <string>      // For C++ string management
 #include <algorithm>   // For std::max() and std::min()
 #include <cmath>       // For std::atan2()
+#include <mutex>       // For std::mutex
+#include <new>         // For std::bad_alloc
+#include <vector>      // For std::vector
+#include <stdexcept>   // For std::runtime_error
+
+#include <fcntl.h>     // For open()
+#include <sys/mman.h>  // For mmap() and munmap()
+#include <sys/stat.h>  // For stat()
+#include <unistd.h>    // For close(), lseek(), pwrite() and ftruncate()
 
 namespace effect{
 	size_t diff(size_t x, size_t y){
@@ -62,26 +74,281 @@ namespace effect{
 		}
 	};
 
+	/** Recycles pixel buffers between bitmaps.
+	 *
+	 *  Buffers are grouped into size classes (powers of two), so that
+	 *  images of similar dimensions processed by the same program reuse
+	 *  each other's memory instead of going back to the system. Buffers
+	 *  larger than `largest` bytes, which a class could make up to twice as
+	 *  large as needed, go straight to and from the system instead. */
+	class buffer_pool{
+	public:
+		static const size_t largest = static_cast<size_t>(1) << 26;
+		
+	private:
+		static const size_t _classes = 27; // Up to the class of `largest`
+		
+		std::vector<void*> _free[_classes];
+		std::mutex         _lock;
+		
+		/** @brief Smallest c with 2^c at least `bytes`, which must be at most `largest`. */
+		static size_t size_class(size_t bytes){
+			return bytes <= 1 ? 0 : 64 - __builtin_clzll(static_cast<unsigned long long>(bytes - 1));
+		}
+		
+	public:
+		buffer_pool() { }
+		buffer_pool(const buffer_pool&) = delete;
+		buffer_pool& operator=(const buffer_pool&) = delete;
+		
+		~buffer_pool(){
+			trim();
+		}
+		
+		/** @brief Returns a buffer of at least `bytes` bytes. */
+		void* acquire(size_t bytes){
+			if(bytes > largest){
+				void *buffer = malloc(bytes);
+				if(buffer == NULL)
+					throw std::bad_alloc();
+				
+				return buffer;
+			}
+			
+			size_t c = size_class(bytes);
+			
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				if(!_free[c].empty()){
+					void *buffer = _free[c].back();
+					_free[c].pop_back();
+					
+					return buffer;
+				}
+			}
+			
+			void *buffer = malloc(static_cast<size_t>(1) << c);
+			if(buffer == NULL)
+				throw std::bad_alloc();
+			
+			return buffer;
+		}
+		
+		/** @brief Hands a buffer obtained through acquire() back to the pool. */
+		void release(void* buffer, size_t bytes){
+			if(buffer == NULL)
+				return;
+			
+			if(bytes > largest){
+				free(buffer);
+				return;
+			}
+			
+			std::lock_guard<std::mutex> guard(_lock);
+			_free[size_class(bytes)].push_back(buffer);
+		}
+		
+		/** @brief Frees every buffer currently held by the pool. */
+		void trim(){
+			std::lock_guard<std::mutex> guard(_lock);
+			for(size_t c = 0; c < _classes; ++c){
+				for(void *buffer : _free[c])
+					free(buffer);
+				_free[c].clear();
+			}
+		}
+		
+		/** @brief Pool shared by every bitmap in the program. */
+		static buffer_pool& global(){
+			static buffer_pool pool;
+			return pool;
+		}
+	};
+
+	/** A non-owning window of width x height pixels into an image.
+	 *
+	 *  Rows start `stride` pixels apart, so a view may cover a region of a
+	 *  larger image, and be processed in place, without copying pixels. */
+	struct BitmapView{
+		size_t width  = 0;
+		size_t height = 0;
+		size_t stride = 0;
+		
+		Pixel<u8>* data = NULL; // Top-left pixel of the view
+		
+		BitmapView() { }
+		
+		BitmapView(size_t width, size_t height, Pixel<u8>* data, size_t stride = 0){
+			this->width  = width;
+			this->height = height;
+			this->stride = stride == 0 ? width : stride;
+			this->data   = data;
+		}
+		
+		const size_t length() const{
+			return width * height;
+		}
+		
+		/** @brief Whether the rows follow each other, with no gap between them. */
+		const bool contiguous() const{
+			return stride == width || height <= 1;
+		}
+		
+		Pixel<u8>* row(size_t y) const{
+			return &data[y * stride];
+		}
+		
+		Pixel<u8>* at(size_t x, size_t y) const{
+			return &data[y * stride + x];
+		}
+		
+		/** @brief Returns the part of this view starting at (x, y), clipped to its bounds. */
+		BitmapView region(size_t x, size_t y, size_t width, size_t height) const{
+			x = std::min(x, this->width);
+			y = std::min(y, this->height);
+			
+			return BitmapView(
+				std::min(width,  this->width  - x),
+				std::min(height, this->height - y),
+				at(x, y),
+				stride
+			);
+		}
+	};
+
+	/** A width x height RGBA image.
+	 *
+	 *  Bitmaps created with a size own their pixels, which are taken from
+	 *  (and given back to) a buffer_pool, and can only be moved. Bitmaps
+	 *  created through map_bitmap() own a shared mapping of their output
+	 *  file instead. Either way, their pixels are accessed without taking
+	 *  ownership through view() and region(), or by conversion to a
+	 *  BitmapView. */
 	struct Bitmap{
-		size_t width;
-		size_t height;
+		size_t width  = 0;
+		size_t height = 0;
 	
-		Pixel<u8>* data;
+		Pixel<u8>* data = NULL;
+		
+		Bitmap() { }
+		
+		Bitmap(size_t width, size_t height, buffer_pool& pool = buffer_pool::global()){
+			// Sizes from a corrupt header could overflow the byte count
+			if(height != 0 && width > SIZE_MAX / sizeof(Pixel<u8>) / height)
+				throw std::bad_alloc();
+			
+			this->width  = width;
+			this->height = height;
+			
+			this->data  = (Pixel<u8>*) pool.acquire(bytes());
+			this->_pool = &pool;
+		}
+		
+		/** @brief Creates a bitmap owning a mapping, whose pixels start at `offset`. */
+		static Bitmap mapped(size_t width, size_t height, void* mapping, size_t length, size_t offset){
+			Bitmap tmp;
+			tmp.width  = width;
+			tmp.height = height;
+			tmp.data   = (Pixel<u8>*) (((u8*) mapping) + offset);
+			
+			tmp._mapping        = mapping;
+			tmp._mapping_length = length;
+			
+			return tmp;
+		}
+		
+		Bitmap(Bitmap&& other){
+			*this = std::move(other);
+		}
+		
+		Bitmap& operator=(Bitmap&& other){
+			if(this != &other){
+				dispose();
+				
+				width  = other.width;
+				height = other.height;
+				data   = other.data;
+				_pool  = other._pool;
+				
+				_mapping        = other._mapping;
+				_mapping_length = other._mapping_length;
+				
+				other.width  = 0;
+				other.height = 0;
+				other.data   = NULL;
+				other._pool  = NULL;
+				
+				other._mapping        = NULL;
+				other._mapping_length = 0;
+			}
+			
+			return *this;
+		}
+		
+		Bitmap(const Bitmap&) = delete;
+		Bitmap& operator=(const Bitmap&) = delete;
+		
+		~Bitmap(){
+			dispose();
+		}
+		
+		/** @brief Returns a view of the whole bitmap. */
+		BitmapView view() const{
+			return BitmapView(width, height, data);
+		}
+		
+		operator BitmapView() const{
+			return view();
+		}
+		
+		/** @brief Returns a view of the part of the bitmap starting at (x, y). */
+		BitmapView region(size_t x, size_t y, size_t width, size_t height) const{
+			return view().region(x, y, width, height);
+		}
+		
+		/** @brief Whether the pixels will be released along with this bitmap. */
+		bool owning() const{
+			return _pool != NULL || _mapping != NULL;
+		}
 	
 		const size_t length() const{
 			return width * height;
 		}
+		
+		const size_t bytes() const{
+			return length() * sizeof(Pixel<u8>);
+		}
 	
 		Bitmap copy() const{
-			Bitmap copy;
-			copy.width  = width;
-			copy.height = height;
-		
-			copy.data = (Pixel<u8>*) malloc(width * height * sizeof(Pixel<u8>));
-			memcpy(copy.data, data, width * height * sizeof(Pixel<u8>));
+			Bitmap copy(width, height);
+			memcpy(copy.data, data, bytes());
 		
 			return copy;
 		}
+		
+		/** @brief Releases the pixels, if owned, and empties the bitmap. */
+		void dispose(){
+			if(_pool != NULL)
+				_pool->release(data, bytes());
+			
+			// Dirty pages are written back by the kernel, no flushing needed.
+			if(_mapping != NULL)
+				munmap(_mapping, _mapping_length);
+			
+			width  = 0;
+			height = 0;
+			data   = NULL;
+			_pool  = NULL;
+			
+			_mapping        = NULL;
+			_mapping_length = 0;
+		}
+		
+	private:
+		buffer_pool *_pool = NULL; // Pool the pixels belong to, NULL if not pooled.
+		
+		void   *_mapping        = NULL; // Mapped file the pixels live in, NULL if not mapped.
+		size_t  _mapping_length = 0;
 	};
 
 	struct hsv{
@@ -124,42 +391,376 @@ namespace effect{
 		}
 	};
 
-	void write_bitmap(Bitmap* bmap, const std::string& output){
-		/** Create the GLT file. */
-		// Signature
+	/** @brief Whether `a` and `b` are the same file, under any name. Files that cannot be looked at are not the same as any other. */
+	bool same_file(const std::string& a, const std::string& b){
+		struct stat first, second;
+		return stat(a.c_str(), &first) == 0 && stat(b.c_str(), &second) == 0 &&
+		       first.st_dev == second.st_dev && first.st_ino == second.st_ino;
+	}
+
+	/** @brief Opens a GLT file and reads its header, leaving the stream at the texture data.
+	 *
+	 *  Throws glt::parse_error if it cannot be read, or its pixels are not in
+	 *  `format`, RGBA unless told otherwise, as they would be read wrong. */
+	FILE* open_bitmap(const std::string& input, glt::texture_header& header, u64 format = GLT_PIXEL_FORMAT_RGBA){
+		FILE *file = fopen(input.c_str(), "rb");
+
+		if(file == NULL)
+			throw glt::parse_error("File \"" + input + "\" could not be open.");
+
 		glt::signature signature;
 
+		if(fread(&signature, sizeof(glt::signature), 1, file) != 1 || !signature.is_valid()){
+			fclose(file);
+			throw glt::parse_error("Signature for file \"" + input + "\" is not valid.");
+		}
+
+		if(fread(&header, sizeof(glt::texture_header), 1, file) != 1){
+			fclose(file);
+			throw glt::parse_error("Texture header for file \"" + input + "\" is not valid.");
+		}
+
+		if(!_LITTLE_ENDIAN()){
+			_FLIP_ENDIAN<u64>(&header.width);
+			_FLIP_ENDIAN<u64>(&header.height);
+
+			_FLIP_ENDIAN<u64>(&header.format);
+		}
+
+		if(header.format != format){
+			fclose(file);
+			throw glt::parse_error("Pixels of file \"" + input + "\" are not in the format expected.");
+		}
+
+		return file;
+	}
+
+	/** @brief Fills a bitmap with the texture data left in `file`, then closes it. */
+	void read_bitmap(FILE* file, Bitmap& bmap){
+		// Missing texture data is filled with zeros, as per the specification.
+		size_t read = fread(bmap.data, 1, bmap.bytes(), file);
+		memset(((u8*) bmap.data) + read, 0, bmap.bytes() - read);
+
+		fclose(file);
+	}
+
+	/** @brief Reads a GLT file into a bitmap whose pixels come from `pool`.
+	 *
+	 *  Behaves like glt::file, throwing glt::parse_error on failure, but
+	 *  reads straight into a recycled buffer instead of a fresh one. */
+	Bitmap load_bitmap(const std::string& input, buffer_pool& pool = buffer_pool::global()){
+		glt::texture_header header;
+		FILE *file = open_bitmap(input, header);
+
+		Bitmap bmap;
+		try{
+			bmap = Bitmap(header.width, header.height, pool);
+		}catch(...){
+			fclose(file);
+			throw;
+		}
+
+		read_bitmap(file, bmap);
+
+		return bmap;
+	}
+
+	/** @brief Fills in the signature and header of a GLT file, RGBA unless told otherwise. */
+	void bitmap_header(size_t width, size_t height, glt::signature& signature, glt::texture_header& header, u64 format = GLT_PIXEL_FORMAT_RGBA){
+		// Signature
 		signature.null = 0;
 
 		signature.magic[0] = 'G';
 		signature.magic[1] = 'L';
 		signature.magic[2] = 'T';
 
+		// Single channel formats were only added in 1.1, masks in 1.2
 		signature.version_major = 1;
-		signature.version_minor = 0;
+		signature.version_minor = format == GLT_PIXEL_FORMAT_RGBA || format == GLT_PIXEL_FORMAT_BGRA ? 0 :
+		                          format == GLT_PIXEL_FORMAT_R1 ? 2 : 1;
 
 		// Texture header
+		header.width  = width;
+		header.height = height;
+
+		header.format = format;
+	}
+
+	/** Reads the texture data of a GLT file a band of rows at a time.
+	 *
+	 *  Only the rows being read need to be kept in memory, so images far larger
+	 *  than the available memory can be processed. Throws glt::parse_error if
+	 *  the file cannot be opened. */
+	class row_reader{
+	private:
+		FILE   *_file;
+		long    _data_offset;
+		size_t  _width;
+		size_t  _height;
+		size_t  _row = 0; // Next row to be read
+		
+	public:
+		row_reader(const std::string& input){
+			glt::texture_header header;
+			_file = open_bitmap(input, header);
+			
+			_width       = header.width;
+			_height      = header.height;
+			_data_offset = ftell(_file);
+		}
+		
+		row_reader(const row_reader&) = delete;
+		row_reader& operator=(const row_reader&) = delete;
+		
+		~row_reader(){
+			fclose(_file);
+		}
+		
+		const size_t width()  const{ return _width;  }
+		const size_t height() const{ return _height; }
+		
+		/** @brief Index of the next row to be read. */
+		const size_t row() const{ return _row; }
+		
+		/** @brief Reads up to `count` rows into `rows`, returning how many were read.
+		 *
+		 *  Rows missing from the end of the file are filled with zeros, as per
+		 *  the specification. */
+		size_t read(Pixel<u8>* rows, size_t count){
+			count = std::min(count, _height - _row);
+			
+			size_t bytes = count * _width * sizeof(Pixel<u8>);
+			size_t read  = fread(rows, 1, bytes, _file);
+			memset(((u8*) rows) + read, 0, bytes - read);
+			
+			_row += count;
+			return count;
+		}
+		
+		/** @brief Goes to row `row`, the next one to be read. */
+		void seek(size_t row){
+			_row = std::min(row, _height);
+			
+			clearerr(_file);
+			fseek(_file, _data_offset + _row * _width * sizeof(Pixel<u8>), SEEK_SET);
+		}
+		
+		/** @brief Goes back to the first row. */
+		void restart(){
+			seek(0);
+		}
+	};
+
+	/** Writes a GLT file a band of rows at a time, in order. Rows are given
+	 *  already laid out in `format`, RGBA unless told otherwise.
+	 *
+	 *  Throws std::runtime_error if the file cannot be created, or any of it
+	 *  cannot be written. Only close() can tell whether the last rows made it
+	 *  to the file, the destructor closes it without telling. */
+	class row_writer{
+	private:
+		FILE   *_file;
+		size_t  _width;
+		size_t  _height;
+		u64     _format;
+		size_t  _row_length;
+		
+	public:
+		row_writer(const std::string& output, size_t width, size_t height, u64 format = GLT_PIXEL_FORMAT_RGBA){
+			_file   = fopen(output.c_str(), "wb");
+			_width  = width;
+			_height = height;
+			_format = format;
+			
+			if(_file == NULL)
+				throw std::runtime_error("Could not open output file.");
+			
+			glt::signature      signature;
+			glt::texture_header header;
+			bitmap_header(width, height, signature, header, format);
+			
+			_row_length = header.row_length();
+			
+			if(fwrite(&signature, sizeof(glt::signature),      1, _file) != 1 ||
+			   fwrite(&header,    sizeof(glt::texture_header), 1, _file) != 1){
+				fclose(_file);
+				throw std::runtime_error("Could not write the output file.");
+			}
+		}
+		
+		row_writer(const row_writer&) = delete;
+		row_writer& operator=(const row_writer&) = delete;
+		
+		~row_writer(){
+			try{
+				close();
+			}catch(const std::runtime_error&){ }
+		}
+		
+		/** @brief Closes the file, writing out what is still buffered. Throws std::runtime_error if that fails. */
+		void close(){
+			if(_file == NULL)
+				return;
+			
+			int closed = fclose(_file);
+			_file = NULL;
+			
+			if(closed != 0)
+				throw std::runtime_error("Could not write the output file.");
+		}
+		
+		const size_t width()  const{ return _width;  }
+		const size_t height() const{ return _height; }
+		const u64    format() const{ return _format; }
+		
+		/** @brief Length of a row, in bytes. */
+		const size_t row_length() const{ return _row_length; }
+		
+		/** @brief Appends `count` rows to the file. */
+		void write(const void* rows, size_t count){
+			if(count != 0 && fwrite(rows, _row_length, count, _file) != count)
+				throw std::runtime_error("Could not write the output file.");
+		}
+	};
+
+	/** @brief Creates a GLT file and maps its texture data as a writable bitmap.
+	 *
+	 *  The header is written up front and the whole file is preallocated, so
+	 *  pixels written to the bitmap land directly in the output file, and the
+	 *  kernel may flush them to disk while the program is still running. Images
+	 *  larger than the available memory can be produced this way. Throws
+	 *  std::runtime_error on failure. */
+	Bitmap map_bitmap(const std::string& output, size_t width, size_t height){
+		glt::signature      signature;
+		glt::texture_header header;
+		bitmap_header(width, height, signature, header);
+
+		const size_t offset = sizeof(glt::signature) + sizeof(glt::texture_header);
+		if(height != 0 && width > (SIZE_MAX - offset) / sizeof(Pixel<u8>) / height)
+			throw std::runtime_error("Output image is too large.");
+
+		const size_t length = offset + width * height * sizeof(Pixel<u8>);
+
+		int file = open(output.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if(file < 0)
+			throw std::runtime_error("Could not open output file.");
+
+		// Not every file system supports preallocation, fall back to a sparse file.
+		if(posix_fallocate(file, 0, length) != 0 && ftruncate(file, length) != 0){
+			close(file);
+			throw std::runtime_error("Could not allocate space for the output file.");
+		}
+
+		if(pwrite(file, &signature, sizeof(glt::signature), 0) != sizeof(glt::signature) ||
+		   pwrite(file, &header, sizeof(glt::texture_header), sizeof(glt::signature)) != sizeof(glt::texture_header)){
+			close(file);
+			throw std::runtime_error("Could not write the output file's header.");
+		}
+
+		void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		close(file);
+
+		if(mapping == MAP_FAILED)
+			throw std::runtime_error("Could not map the output file.");
+
+		return Bitmap::mapped(width, height, mapping, length, offset);
+	}
+
+	/** @brief Maps an existing GLT file, as map_bitmap() does a new one, keeping its pixels.
+	 *
+	 *  Returns an empty bitmap if the file cannot be read, or does not hold a
+	 *  whole width x height RGBA texture, so callers can fall back to
+	 *  map_bitmap(). Throws std::runtime_error if it cannot be mapped. */
+	Bitmap reopen_bitmap(const std::string& output, size_t width, size_t height){
+		glt::texture_header header;
+		try{
+			fclose(open_bitmap(output, header));
+		}catch(const glt::parse_error&){
+			return Bitmap();
+		}
+
+		if(header.width != width || header.height != height || header.format != GLT_PIXEL_FORMAT_RGBA)
+			return Bitmap();
+
+		const size_t offset = sizeof(glt::signature) + sizeof(glt::texture_header);
+		const size_t length = offset + width * height * sizeof(Pixel<u8>);
+
+		int file = open(output.c_str(), O_RDWR);
+		if(file < 0)
+			return Bitmap();
+
+		// Pages past the end of a short file cannot be touched once mapped
+		off_t end = lseek(file, 0, SEEK_END);
+		if(end < 0 || static_cast<size_t>(end) < length){
+			close(file);
+			return Bitmap();
+		}
+
+		void *mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		close(file);
+
+		if(mapping == MAP_FAILED)
+			throw std::runtime_error("Could not map the output file.");
+
+		return Bitmap::mapped(width, height, mapping, length, offset);
+	}
+
+	/** @brief Maps a new GLT file, as in map_bitmap(), holding a copy of another one.
+	 *
+	 *  The input's texture data is read straight into the mapping, so effects
+	 *  applied in place are written to the output without a separate copy.
+	 *  Throws std::runtime_error if the output is the input file itself, under
+	 *  any name, as it would be truncated before it is read. */
+	Bitmap map_bitmap(const std::string& output, const std::string& input){
 		glt::texture_header header;
+		FILE *file = open_bitmap(input, header);
 
-		header.width  = bmap->width;
-		header.height = bmap->height;
+		if(same_file(input, output)){
+			fclose(file);
+			throw std::runtime_error("Output file must not be the input file.");
+		}
 
-		header.format = GLT_PIXEL_FORMAT_RGBA;
+		Bitmap bmap;
+		try{
+			bmap = map_bitmap(output, header.width, header.height);
+		}catch(...){
+			fclose(file);
+			throw;
+		}
+
+		read_bitmap(file, bmap);
+
+		return bmap;
+	}
+
+	/** @brief Writes `bmap` to a new GLT file. Throws std::runtime_error if any of it cannot be written. */
+	void write_bitmap(const BitmapView& bmap, const std::string& output){
+		/** Create the GLT file. */
+		glt::signature      signature;
+		glt::texture_header header;
+		bitmap_header(bmap.width, bmap.height, signature, header);
 
 		/** Write to the GLT file. */
 		FILE *file = fopen(output.c_str(), "wb");
 
-		if(file == NULL){
-		    fprintf(stderr, "Could not open output file.\n");
-		    return;
-		}
+		if(file == NULL)
+			throw std::runtime_error("Could not open output file.");
 
-		fwrite(&signature, sizeof(glt::signature),      1, file);
-		fwrite(&header,    sizeof(glt::texture_header), 1, file);
+		bool written = fwrite(&signature, sizeof(glt::signature),      1, file) == 1 &&
+		               fwrite(&header,    sizeof(glt::texture_header), 1, file) == 1;
 
-		// Write texture bytes
-		fwrite(bmap->data, sizeof(Pixel<u8>), bmap->length(), file);
+		// Write texture bytes, a row at a time if they are not contiguous
+		if(bmap.contiguous()){
+			written = written && fwrite(bmap.data, sizeof(Pixel<u8>), bmap.length(), file) == bmap.length();
+		}else{
+			for(size_t y = 0; y < bmap.height && written; ++y)
+				written = fwrite(bmap.row(y), sizeof(Pixel<u8>), bmap.width, file) == bmap.width;
+		}
 
-		fclose(file);
+		// Buffered data is only written out when the file is closed
+		if(fclose(file) != 0 || !written)
+			throw std::runtime_error("Could not write the output file.");
 	}
 }
+
+#endif // __EFFECT_H__
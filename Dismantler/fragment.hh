@@ -2,80 +2,240 @@
 #define __FRAGMENT_H__
 
 #include "effect.hh"
+#include "aes.hh"
 
+#include <algorithm>
+#include <random>
+#include <type_traits>
 #include <vector>
 
 namespace fragment{
+	/** Values of AES-128 in counter mode, encrypting a nonce alongside a
+	 *  running count of blocks.
+	 *
+	 *  Blocks are encrypted eight at a time, through AES-NI where there is
+	 *  one, and values handed out from them until they run out. Right after
+	 *  seeding, only one block is, as version 1 reseeds for every value it
+	 *  draws. Generators are only ever made from a key, keyed with a hash of
+	 *  the key itself, and take the block they are for as their nonce.
+	 *  Seeding only changes the nonce, never the key.
+	 *
+	 *  Images dismantled with it come back exactly when the scheme gives
+	 *  them back, which for version 1 is not so for many images an even
+	 *  number of pixels across, such as 256x256 or 640x480. */
+	class aes_random_generator{
+	public:
+		typedef u64 result_type;
+		
+		static constexpr result_type min(){ return 0; }
+		static constexpr result_type max(){ return ~static_cast<result_type>(0); }
+		
+		aes_random_generator(const aes::round_keys& keys, u64 nonce) : _keys(keys){
+			seed(nonce);
+		}
+		
+		void seed(u64 nonce){
+			_nonce   = nonce;
+			_counter = 0;
+			_next    = 0;
+			_end     = 0;
+		}
+		
+		result_type operator()(){
+			if(_next == _end)
+				refill();
+			
+			return _stream[_next++];
+		}
+		
+	private:
+		static const size_t blocks = 8;
+		static const size_t words  = blocks * aes::block / sizeof(u64);
+		
+		aes::round_keys _keys;
+		u64             _nonce   = 0;
+		u64             _counter = 0;
+		
+		u64    _stream[words];
+		size_t _next = 0;
+		size_t _end  = 0;
+		
+		/** @brief Encrypts the next blocks, read as values a little-endian word at a time, whatever the host.
+		 *
+		 *  Only the first block after seeding is encrypted on its own, so the
+		 *  values are the same however many blocks are encrypted at once. */
+		void refill(){
+			const size_t count = _counter == 0 ? 1 : blocks;
+			
+			u64 in[words], out[words];
+			for(size_t b = 0; b < count; ++b){
+				in[b * 2]     = little_endian(_nonce);
+				in[b * 2 + 1] = little_endian(_counter + b);
+			}
+			
+			aes::encrypt(_keys, reinterpret_cast<const u8*>(in), reinterpret_cast<u8*>(out), count);
+			_counter += count;
+			
+			for(size_t w = 0; w < count * 2; ++w)
+				_stream[w] = little_endian(out[w]);
+			
+			_next = 0;
+			_end  = count * 2;
+		}
+		
+		/** @brief Swaps the bytes of `x` on big-endian hosts, so it is laid out as it is on little-endian ones. */
+		static u64 little_endian(u64 x){
+			#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			return __builtin_bswap64(x);
+			#else
+			return x;
+			#endif
+		}
+	};
+	
 	// Typenames for default random generator and distribution
 	typedef std::minstd_rand                      light_random_generator;
 	typedef std::mt19937_64                       heavy_random_generator;
+	typedef aes_random_generator                  secure_random_generator;
 	typedef std::uniform_int_distribution<size_t> distribution;
 	
+	/** Latest version of the way images are dismantled. Images can only be
+	 *  remantled with the version that dismantled them, which is not written
+	 *  down anywhere, so the tools run default_scheme unless told otherwise.
+	 *
+	 *  Every version derives schedules from keys the same way. Version 1
+	 *  shifts colours with the generator of the block, reseeded for every
+	 *  channel of every pixel, version 2 with shift_hash(). Version 3 shifts
+	 *  them as version 2 does, but runs a schedule over every tile of the
+	 *  image on its own, from a key of the tile's own.
+	 *
+	 *  Version 1 moves the far quarters of a block that spans the image back
+	 *  inside it, onto the near ones when the image is an even number of
+	 *  pixels across, so not every image it dismantles can be remantled.
+	 *  Versions 2 and 3 keep quarters apart, so every image can be. */
+	static const size_t scheme_version = 3;
+	
+	/** Version the tools and libdismantle run when none is asked for. */
+	static const size_t default_scheme = 1;
+	
+	/** Side of the tiles of version 3, in pixels. Tiles at the right and bottom edges may be smaller. */
+	static const size_t tile_size = 256;
+	
+	/** @brief Whether version `scheme` runs over tiles, rather than over the whole image. */
+	inline bool tiled(size_t scheme){
+		return scheme >= 3;
+	}
+	
+	/** @brief Whether version `scheme` keeps the quarters of every block apart, see pixel_block::subblock(). */
+	inline bool disjoint(size_t scheme){
+		return scheme >= 2;
+	}
+	
+	/** @brief Number of tiles needed to cover `length` pixels. */
+	inline size_t tiles(size_t length){
+		return (length + tile_size - 1) / tile_size;
+	}
+	
+	/** @brief Mixes the bits of `z`, as SplitMix64's finalizer does. Every value maps to a different one. */
+	inline u64 mix(u64 z){
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+		return z ^ (z >> 31);
+	}
+	
+	/** @brief Mixes the bits of `x`, as lowbias32 does. Every value maps to a different one.
+	 *
+	 *  Only 32-bit multiplies and shifts, so a whole vector of pixels can be
+	 *  hashed at once. */
+	inline u32 shift_hash(u32 x){
+		x ^= x >> 16;
+		x *= 0x7FEB352D;
+		x ^= x >> 15;
+		x *= 0x846CA68B;
+		return x ^ (x >> 16);
+	}
+	
+	/** @brief Draws a value from 0 to `count` - 1 out of `generator`.
+	 *
+	 *  Unlike the standard distributions, whose algorithms are left to the
+	 *  library, this draws the same values everywhere, as the engines do. */
+	template<typename Generator>
+	size_t draw(Generator& generator, size_t count){
+		return static_cast<size_t>((generator() - Generator::min()) % count);
+	}
+	
+	/** A key, and the generators it derives for every block of a schedule.
+	 *
+	 *  Nothing is kept between derivations: every block's generator is seeded
+	 *  with a keyed hash of where the block is, so blocks can be derived in
+	 *  any order, on any thread, always getting the same values. */
 	template<typename Generator = heavy_random_generator, typename Distribution = distribution>
 	class key {
 	private:
-		std::vector<size_t> _values;
-		size_t _base_salt = 1;
-		size_t _rehashes  = 0;
+		u64    _digest = 0;
+		size_t _length = 0;
 		
-	public:
-		key(std::string key){
-			// Calculate the base salt
-			_base_salt = std::hash<std::string>()(key);
+		// Round keys, from a hash of the key, for generators that take one
+		aes::round_keys _rounds;
 		
-			// Hash and copy the key
-			std::hash<char> hasher;
-			for(char c : key){
-				_values.push_back(hasher(c));
-			}
+		template<typename Other>
+		static Other make(u64 counter, const aes::round_keys&, std::false_type){
+			return Other(counter);
+		}
+		
+		template<typename Other>
+		static Other make(u64 counter, const aes::round_keys& rounds, std::true_type){
+			return Other(rounds, counter);
 		}
 		
-		void rehash(){
-			++_rehashes;
+	public:
+		typedef Generator generator;
+		
+		key(std::string key){
+			// Hash the key a byte at a time, the same everywhere
+			_digest = mix(key.size());
+			for(char c : key)
+				_digest = mix(_digest ^ static_cast<u8>(c));
 			
-			Generator generator;
-			generator.seed(_base_salt);
+			_length = key.size();
 			
-			Distribution value_dist(0, _values.size() - 1);
-			Distribution power_dist(-10, 10);
-			Distribution salt_dist (-10, 10);
+			u8 hash[aes::block];
+			aes::digest(key, hash);
+			_rounds = aes::expand(hash);
+		}
+		
+		/** @brief Key of the tile in column `tx` and row `ty`, derived from this one. */
+		key tile(u64 tx, u64 ty) const{
+			key tmp = *this;
+			tmp._digest = mix(mix(mix(_digest ^ 0x3) ^ tx) ^ ty);
 			
-			// For every node, determine another node, which will be used
-			// to generate the number that will be used as factor. 
-			// 
-			// Then, hash the result into the value that will be saved
-			for(size_t i = 0; i < _values.size(); ++i){
-				size_t salt_rnd = salt_dist(generator);
-				size_t salt = (((i + 1) * _base_salt) / _rehashes) * (salt_rnd == 0 ? -1 : salt_rnd);
-				
-				generator.seed((_values[i] + 1) * salt);
-				size_t j = value_dist(generator);
-				
-				generator.seed((_values[j] + 1) * salt);
-				size_t factor = power_dist(generator);
-				factor = factor == 0 ? -1 : factor;
-				
-				_values[i] = std::hash<size_t>()((_values[i] + 1) * factor);
-			}
+			return tmp;
 		}
 		
-		const std::vector<size_t> values() const{
-			return _values;
+		/** @brief Hash of the key itself, which everything derived from it starts from. */
+		const u64 digest() const{
+			return _digest;
 		}
 		
-		const size_t average() const{
-			size_t value = 0;
-			
-			for(size_t node : _values){
-				value += node;
-			}
-			value /= _values.size();
-			
-			return value;
+		/** @brief Number of opcodes every operation runs, one per character of the key. */
+		const size_t length() const{
+			return _length;
 		}
 		
-		const size_t average_hash() const{
-			return std::hash<size_t>()(this->average());
+		/** @brief Keyed hash of a block's level and position. */
+		const u64 counter(u64 level, u64 x, u64 y) const{
+			return mix(mix(mix(_digest ^ level) ^ x) ^ y);
+		}
+		
+		/** @brief Generator for the block at (x, y) of `level`, seeded from counter(), and keyed with the key if it takes one. */
+		Generator generator_for(u64 level, u64 x, u64 y) const{
+			return keyed<Generator>(counter(level, x, y));
+		}
+		
+		/** @brief Generator of any type, seeded with `nonce`, and keyed with the key if it takes one. */
+		template<typename Other>
+		Other keyed(u64 nonce) const{
+			return make<Other>(nonce, _rounds, std::is_constructible<Other, const aes::round_keys&, u64>());
 		}
 	};
 	
@@ -99,14 +259,65 @@ namespace fragment{
 		size_t data_height;
 		effect::Pixel<u8> *data;
 		
-		pixel_block subblock(u8 ox, u8 oy){
+		/** @brief The block covering the whole of `image`. */
+		static pixel_block whole(const effect::BitmapView& image){
+			pixel_block tmp = {
+				0, 0, 
+				image.width, image.height, 
+				
+				image.stride, image.height,
+				image.data
+			};
+			
+			return tmp;
+		}
+		
+		/** @brief The block covering the tile in column `tx` and row `ty` of an image `height` pixels tall.
+		 *
+		 *  `rows` holds the image's rows from `top` on, whole. Blocks only ever
+		 *  look at the size of the image their rows belong to, so a tile gets
+		 *  the same block whether all of the image was read, or only its rows. */
+		static pixel_block tile(const effect::BitmapView& rows, size_t top, size_t height, size_t tx, size_t ty){
+			const size_t x = tx * tile_size;
+			const size_t y = ty * tile_size;
+			
+			pixel_block tmp = {
+				0, 0, 
+				std::min(tile_size, rows.width - x), std::min(tile_size, height - y), 
+				
+				rows.stride, height,
+				&rows.data[(y - top) * rows.stride + x]
+			};
+			
+			return tmp;
+		}
+		
+		/** @brief Whether quarters `a` and `b` of the same block share any pixels. */
+		static bool overlap(const pixel_block& a, const pixel_block& b){
+			return effect::diff(a.x, b.x) < std::min(a.width,  b.width) && 
+			       effect::diff(a.y, b.y) < std::min(a.height, b.height);
+		}
+		
+		/** @brief Quarter (ox, oy) of the block, half its width and height.
+		 *
+		 *  `disjoint` quarters are taken from the far edges of the block, so
+		 *  they never overlap, leaving the middle column and row of an odd
+		 *  block alone. Otherwise, as version 1 does, far quarters start
+		 *  halfway across, and are moved back inside the image if they reach
+		 *  its edge. */
+		pixel_block subblock(u8 ox, u8 oy, bool disjoint = false){
 			size_t new_x = (ox ? (width  / 2) : 0);
 			size_t new_y = (oy ? (height / 2) : 0);
 			
-			if(new_x + (width  / 2) >= data_width)
-				new_x = (data_width  - (width  / 2) - 1);
-			if(new_y + (height / 2) >= data_height)
-				new_y = (data_height - (height / 2) - 1);
+			if(disjoint){
+				new_x = (ox ? width  - (width  / 2) : 0);
+				new_y = (oy ? height - (height / 2) : 0);
+			}else{
+				if(new_x + (width  / 2) >= data_width)
+					new_x = (data_width  - (width  / 2) - 1);
+				if(new_y + (height / 2) >= data_height)
+					new_y = (data_height - (height / 2) - 1);
+			}
 			
 			pixel_block tmp = { 
 				new_x, 
@@ -121,78 +332,312 @@ namespace fragment{
 			return tmp;
 		}
 		
-		//pixel_block 
+		/** @brief Swaps the quarters at (ox1, oy1) and (ox2, oy2), as subblock() gives them.
+		 *
+		 *  Quarters are swapped in place, a row at a time. Only where subblock()
+		 *  moves a quarter back inside the image can they overlap, in which case
+		 *  they go through the same three copies, column by column, that every
+		 *  swap used to, so the result is the same. The scratch buffer for those
+		 *  is kept for the next one, on every thread. */
+		void swap(u8 ox1, u8 oy1, u8 ox2, u8 oy2, bool disjoint = false){
+			pixel_block block1 = subblock(ox1, oy1, disjoint);
+			pixel_block block2 = subblock(ox2, oy2, disjoint);
+			
+			if(block1.data == block2.data)
+				return;
+			
+			if(!overlap(block1, block2)){
+				for(size_t y = 0; y < block1.height; ++y)
+					std::swap_ranges(block1.at(0, y), block1.at(0, y) + block1.width, block2.at(0, y));
+				
+				return;
+			}
+			
+			static thread_local std::vector<effect::Pixel<u8>> scratch;
+			scratch.resize(block2.width * block2.height);
+			
+			pixel_block tmp = {
+				0, 0,
+				block2.width, block2.height,
+				
+				block2.width, block2.height,
+				scratch.data()
+			};
+			
+			copy(tmp,    block2);
+			copy(block2, block1);
+			copy(block1, tmp);
+		}
+		
+		/** @brief `pixel` shifted by `source`, with `h` the hash of where it is, and `sign` 1, or -1 to take the shift off. */
+		static effect::Pixel<u8> shifted(effect::Pixel<u8> pixel, effect::Pixel<u8> source, u32 h, u8 sign){
+			pixel.red   += sign * static_cast<u8>(shift_hash(h ^ (0x000 | source.red)));
+			pixel.green += sign * static_cast<u8>(shift_hash(h ^ (0x100 | source.green)));
+			pixel.blue  += sign * static_cast<u8>(shift_hash(h ^ (0x200 | source.blue)));
+			pixel.alpha += sign * static_cast<u8>(shift_hash(h ^ (0x300 | source.alpha)));
+			
+			return pixel;
+		}
 		
+		/** @brief Shifts the colours of one of the quarters at (ox1, oy1) and (ox2, oy2) by the other, as versions 2 and 3 do.
+		 *
+		 *  Every channel of a pixel is shifted by a hash of `salt`, where the
+		 *  pixel is, and the same channel of the pixel in the other quarter,
+		 *  which is left alone. `undo` takes the shifts back off instead.
+		 *  Rows are shifted in parallel, a vector of pixels at a time, unless
+		 *  the quarters overlap, in which case pixels go one at a time, in
+		 *  order, or in reverse when undoing. */
+		void shift(u8 ox1, u8 oy1, u8 ox2, u8 oy2, u64 salt, bool undo, bool disjoint = false){
+			pixel_block dest   = subblock(ox1, oy1, disjoint);
+			pixel_block source = subblock(ox2, oy2, disjoint);
+			
+			// A quarter shifted by itself could not be shifted back
+			if(dest.data == source.data)
+				return;
+			
+			u32 seed = static_cast<u32>(mix(salt ^ (ox1 | oy1 << 1 | ox2 << 2 | oy2 << 3)));
+			if(seed & 1)
+				std::swap(dest, source);
+			
+			const size_t width  = std::min(dest.width,  source.width);
+			const size_t height = std::min(dest.height, source.height);
+			const u8     sign   = undo ? 0xFF : 0x01;
+			
+			if(!overlap(dest, source)){
+				#pragma omp parallel for schedule(static)
+				for(size_t y = 0; y < height; ++y){
+					u32 row = shift_hash(seed ^ static_cast<u32>(y));
+					
+					effect::Pixel<u8>       *d = dest.at(0, y);
+					const effect::Pixel<u8> *c = source.at(0, y);
+					
+					#pragma omp simd
+					for(size_t x = 0; x < width; ++x)
+						d[x] = shifted(d[x], c[x], shift_hash(row ^ static_cast<u32>(x)), sign);
+				}
+			}else if(!undo){
+				for(size_t y = 0; y < height; ++y){
+					u32 row = shift_hash(seed ^ static_cast<u32>(y));
+					for(size_t x = 0; x < width; ++x)
+						*dest.at(x, y) = shifted(*dest.at(x, y), *source.at(x, y), shift_hash(row ^ static_cast<u32>(x)), sign);
+				}
+			}else{
+				for(size_t y = height; y-- > 0;){
+					u32 row = shift_hash(seed ^ static_cast<u32>(y));
+					for(size_t x = width; x-- > 0;)
+						*dest.at(x, y) = shifted(*dest.at(x, y), *source.at(x, y), shift_hash(row ^ static_cast<u32>(x)), sign);
+				}
+			}
+		}
 		
 		effect::Pixel<u8> *at(size_t x, size_t y){
 			return &data[y * data_width + x];
 		}
 	};
 	
+	/** An operation on a block: where the block is, and the level it belongs to.
+	 *
+	 *  Opcodes are not kept, but derived again whenever the operation is run,
+	 *  through schedule::opcodes(). */
 	struct operation{
-		size_t opcode_table[0xC];
-		std::vector<size_t> code;
-			
 		pixel_block block;
+		size_t      level;
+		size_t      index; // Counting every level
+	};
+	
+	/** Where the blocks of a level of a schedule start. */
+	struct level{
+		size_t block_width;
+		size_t block_height;
+		
+		// Blocks start half a block apart
+		size_t step_x;
+		size_t step_y;
+		size_t columns;
+		size_t rows;
+		
+		size_t first; // Index of the level's first operation
+		
+		/** @brief Rows between the blocks of a column that share a wave.
+		 *
+		 *  Blocks overlap those in the rows next to them. When they are an odd
+		 *  number of pixels tall, their last row is also the first of the
+		 *  block two rows down, which only disjoint quarters reach. */
+		size_t spread() const{
+			return block_height % 2 == 0 ? 2 : 3;
+		}
+		
+		/** @brief Number of waves the level's operations are run in.
+		 *
+		 *  Wave spread() * i + j, which holds the block in column i and row j,
+		 *  comes after every block before it that it overlaps, in its own
+		 *  column or any other, so none of the blocks of a wave overlap.
+		 *  Running the waves in order, each one in parallel, gives the same
+		 *  pixels as running the blocks column by column, and running them
+		 *  backwards undoes them. */
+		size_t waves() const{
+			return spread() * (columns - 1) + rows;
+		}
+		
+		/** @brief First column with a block in wave `t`. */
+		size_t wave_begin(size_t t) const{
+			return t < rows ? 0 : (t - rows) / spread() + 1;
+		}
+		
+		/** @brief Column after the last one with a block in wave `t`. */
+		size_t wave_end(size_t t) const{
+			return std::min(columns, t / spread() + 1);
+		}
+		
+		/** @brief Row of the block in column `i` of wave `t`. */
+		size_t wave_row(size_t t, size_t i) const{
+			return t - spread() * i;
+		}
 	};
 	
+	/** The operations run over every block of an image, level by level, from
+	 *  the largest blocks down.
+	 *
+	 *  Blocks of a level start half a block apart, and their operations are
+	 *  listed column by column. Nothing but the levels is kept: operation i
+	 *  is worked out on demand, in constant time, so a schedule takes the
+	 *  same memory for any image, and can be walked forwards, backwards, or
+	 *  in any other order. Each operation's opcodes come from the generator
+	 *  the key gives its level and position, so every thread derives the
+	 *  same ones. */
 	template<typename Generator = heavy_random_generator>
-	std::vector<operation> block_operations(key<Generator>& key, pixel_block& block){
-		std::vector<operation> tmp;
-		
-		for(size_t block_width = block.width, block_height = block.height;
-			block_width >= 2 && block_height >= 2; 
-			block_width /= 2, block_height /= 2){
-			
-			printf("New block dimentions: %zux%zu...", block_width, block_height);
-			#pragma omp parallel for ordered collapse(2)
-			for(size_t x = 0; x < block.width; x += block_width / 2){
-				for(size_t y = 0; y < block.height; y += block_height / 2){
-					// Redo the hashing
-					key.rehash();
-			
-					// Set up the block operation
-					operation op;
-					op.block = {
-						x, y, 
-						x + block_width  > block.width  ? block.width  - x - 1 : block_width, 
-						y + block_height > block.height ? block.height - y - 1 : block_height, 
-					
-						block.data_width, block.data_height, 
-						&block.data[y * block.data_width + x]
-					};
-					
+	class schedule{
+	private:
+		key<Generator>     _key;
+		pixel_block        _block;
+		std::vector<level> _levels;
+		size_t             _size = 0;
+		
+		// Opcodes of every operation, when they were derived ahead
+		const u8          *_stored = NULL;
+		
+	public:
+		schedule(const key<Generator>& key, const pixel_block& block) : _key(key), _block(block){
+			for(size_t block_width = block.width, block_height = block.height;
+				block_width >= 2 && block_height >= 2; 
+				block_width /= 2, block_height /= 2){
+				
+				level l;
+				l.block_width  = block_width;
+				l.block_height = block_height;
+				l.step_x       = block_width  / 2;
+				l.step_y       = block_height / 2;
+				l.columns      = (block.width  + l.step_x - 1) / l.step_x;
+				l.rows         = (block.height + l.step_y - 1) / l.step_y;
+				l.first        = _size;
+				
+				_levels.push_back(l);
+				_size += l.columns * l.rows;
+			}
+		}
+		
+		/** @brief Number of operations. */
+		const size_t size() const{
+			return _size;
+		}
+		
+		const std::vector<level>& levels() const{
+			return _levels;
+		}
+		
+		/** @brief Identity of the schedule: the key it comes from and the size of the image it runs over. */
+		u64 identity() const{
+			return mix(mix(mix(_key.digest() ^ _key.length()) ^ _block.width) ^ _block.height);
+		}
+		
+		/** @brief Size of the image the schedule runs over. */
+		size_t width() const{
+			return _block.width;
+		}
+		
+		size_t height() const{
+			return _block.height;
+		}
+		
+		/** @brief Number of opcodes every operation runs. */
+		size_t length() const{
+			return _key.length();
+		}
+		
+		/** @brief Takes the opcodes of every operation from `stored`, size() runs of length() of them, instead of deriving them.
+		 *
+		 *  `stored` must stay mapped for as long as the schedule is run. */
+		void use(const u8* stored){
+			_stored = stored;
+		}
+		
+		/** @brief Operation on the block in column `i` and row `j` of level `l`. */
+		operation at(size_t l, size_t i, size_t j) const{
+			const level& lv = _levels[l];
 			
-					// Setup opcode table and opcodes
-					Generator rnd;
-					fragment::distribution swap_dist(0, 0xB);
+			size_t x = i * lv.step_x;
+			size_t y = j * lv.step_y;
 			
-					#define so(slot) \
-						rnd.seed(key.average() * (slot + 1)); \
-						op.opcode_table[slot] = swap_dist(rnd);
-					
-					so(0x0); so(0x1);
-					so(0x2); so(0x3);
-					so(0x4); so(0x5);
-					so(0x6); so(0x7);
-					so(0x8); so(0x9);
-					so(0xA); so(0xB);
-					
-					#undef so
-					for(size_t node : key.values()){
-						rnd.seed(node);
-						op.code.push_back(swap_dist(rnd));
-					}
-					
-					#pragma omp critical
-					tmp.push_back(op);
-				}
+			operation op;
+			op.level = l;
+			op.index = lv.first + i * lv.rows + j;
+			op.block = {
+				x, y, 
+				x + lv.block_width  > _block.width  ? _block.width  - x - 1 : lv.block_width, 
+				y + lv.block_height > _block.height ? _block.height - y - 1 : lv.block_height, 
+			
+				_block.data_width, _block.data_height, 
+				&_block.data[y * _block.data_width + x]
+			};
+			
+			return op;
+		}
+		
+		/** @brief Operation `index`, counting every level. */
+		operation operator[](size_t index) const{
+			size_t l = _levels.size() - 1;
+			while(_levels[l].first > index)
+				--l;
+			
+			const level& lv = _levels[l];
+			index -= lv.first;
+			
+			return at(l, index / lv.rows, index % lv.rows);
+		}
+		
+		/** @brief Generator of any type, keyed with the schedule's key if it takes one, for the colour shifts of version 1. */
+		template<typename Other>
+		Other keyed() const{
+			return _key.template keyed<Other>(0);
+		}
+		
+		/** @brief Keyed hash of `op`, salting the colour shifts of version 2. */
+		u64 salt(const operation& op) const{
+			return mix(_key.counter(op.level, op.block.x, op.block.y));
+		}
+		
+		/** @brief Derives the opcodes of `op` into `code`, in the order they are run.
+		 *
+		 *  A table of 0xC opcodes is drawn first, then an index into it for every
+		 *  character of the key. `code` is only resized, so it can be reused from
+		 *  one operation to the next. */
+		void opcodes(const operation& op, std::vector<u8>& code) const{
+			if(_stored != NULL){
+				code.assign(_stored + op.index * length(), _stored + (op.index + 1) * length());
+				return;
 			}
 			
-			printf("Done!\n");
+			Generator rnd = _key.generator_for(op.level, op.block.x, op.block.y);
+			
+			u8 table[0xC];
+			for(size_t slot = 0; slot < 0xC; ++slot)
+				table[slot] = static_cast<u8>(draw(rnd, 0xC));
+			
+			code.resize(_key.length());
+			for(u8& opcode : code)
+				opcode = table[draw(rnd, 0xC)];
 		}
-		return tmp;
-	}
+	};
 }
 
 #endif // __FRAGMENT_H__
@@ -0,0 +1,98 @@
+#include "libdismantle.hh"
+#include "scramble.hh"
+
+#include <functional> // For std::function
+#include <stdexcept>  // For std::invalid_argument
+
+namespace dismantler{
+	struct context::state{
+		size_t complexity = 1;
+		size_t scheme     = fragment::default_scheme;
+
+		// Runs the key over an image, deriving opcodes as it goes
+		std::function<void(const effect::BitmapView&, bool)> apply;
+
+		template<typename G1, typename G2>
+		void bind(const std::string& phrase){
+			const fragment::key<G1> key(phrase);
+			const size_t            scheme = this->scheme;
+
+			// Opcodes are derived from the schedule as it is run, which takes
+			// the same memory for any size of image, so none are kept
+			apply = [key, scheme](const effect::BitmapView& image, bool undo){
+				scramble::apply_image<G1, G2>(key, image, NULL, scheme, undo);
+			};
+		}
+	};
+
+	context::context(const std::string& key, const options& opts) : _state(new state()){
+		if(opts.complexity > 3 || opts.scheme > fragment::scheme_version)
+			throw std::invalid_argument("Dismantler options are not valid.");
+
+		_state->complexity = opts.complexity;
+		_state->scheme     = opts.scheme == 0 ? fragment::scheme_version : opts.scheme;
+
+		if(opts.complexity == 0)
+			_state->bind<fragment::light_random_generator, fragment::light_random_generator>(key);
+		else if(opts.complexity == 1)
+			_state->bind<fragment::heavy_random_generator, fragment::light_random_generator>(key);
+		else if(opts.complexity == 2)
+			_state->bind<fragment::heavy_random_generator, fragment::heavy_random_generator>(key);
+		else
+			_state->bind<fragment::secure_random_generator, fragment::secure_random_generator>(key);
+	}
+
+	context::~context() { }
+
+	context::context(context&& other) = default;
+	context& context::operator=(context&& other) = default;
+
+	void context::dismantle(u8* buffer, size_t width, size_t height, size_t stride) const{
+		run(buffer, width, height, stride, false);
+	}
+
+	void context::remantle(u8* buffer, size_t width, size_t height, size_t stride) const{
+		run(buffer, width, height, stride, true);
+	}
+
+	void context::run(u8* buffer, size_t width, size_t height, size_t stride, bool undo) const{
+		const size_t pixel = sizeof(effect::Pixel<u8>);
+
+		if(stride == 0)
+			stride = width * pixel;
+		if(stride < width * pixel || stride % pixel != 0)
+			throw std::invalid_argument("Rows of the image overlap, or are not whole pixels apart.");
+		if(width == 0 || height == 0)
+			return;
+		if(buffer == NULL)
+			throw std::invalid_argument("Image has no pixels.");
+
+		effect::BitmapView image(width, height, reinterpret_cast<effect::Pixel<u8>*>(buffer), stride / pixel);
+
+		if(image.contiguous()){
+			_state->apply(image, undo);
+			return;
+		}
+
+		// Blocks take the stride for the width of the image, so rows apart
+		// are packed together first, for the same pixels the tools give, and
+		// for nothing between the rows to be touched
+		effect::Bitmap     bitmap(width, height);
+		effect::BitmapView packed = bitmap.view();
+		for(size_t y = 0; y < height; ++y)
+			memcpy(packed.row(y), image.row(y), width * pixel);
+
+		_state->apply(packed, undo);
+
+		for(size_t y = 0; y < height; ++y)
+			memcpy(image.row(y), packed.row(y), width * pixel);
+	}
+
+	void dismantle(u8* buffer, size_t width, size_t height, size_t stride, const std::string& key, const options& opts){
+		context(key, opts).dismantle(buffer, width, height, stride);
+	}
+
+	void remantle(u8* buffer, size_t width, size_t height, size_t stride, const std::string& key, const options& opts){
+		context(key, opts).remantle(buffer, width, height, stride);
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef __LIBDISMANTLE_H__
+#define __LIBDISMANTLE_H__
+
+#include <cstddef> // For size_t, which int.hpp needs declared
+#include <memory>  // For std::unique_ptr
+#include <string>  // For std::string
+
+#include "glt/int.hpp"
+
+/** The Dismantler as a library, for programs that hold images in memory
+ *  rather than in GLT files. Buffers belong to the caller, hold 8-bit RGBA
+ *  pixels, laid out as in GLT's RGBA8 format, and are changed in place.
+ *  Images come out exactly as the dismantle and remantle tools write them.
+ *
+ *  Built from libdismantle.cc and glt/glt.cc, with OpenMP, into a library of
+ *  its own. This header is all its users need. Nothing is shared between
+ *  calls but the context they are given, so any number of them can run at
+ *  once, from any number of threads. */
+namespace dismantler{
+	struct options{
+		size_t complexity = 1; // 0 to 3, as --complexity takes it
+		size_t scheme     = 1; // Version of the Dismantler, as --scheme takes it, or 0 for the latest
+	};
+
+	/** A key and its options, set up once, for any number of images.
+	 *
+	 *  Everything derived from the key alone is worked out when the context
+	 *  is made. Opcodes are derived as images are run, so a context takes
+	 *  the same memory however many images, of whatever sizes, it is given.
+	 *  Contexts can be used from any number of threads at once. */
+	class context{
+	public:
+		/** Throws std::invalid_argument if the options are not valid. */
+		context(const std::string& key, const options& opts = options());
+		~context();
+
+		context(context&& other);
+		context& operator=(context&& other);
+
+		context(const context&) = delete;
+		context& operator=(const context&) = delete;
+
+		/** @brief Dismantles the width x height pixels in `buffer`, their rows `stride` bytes apart, or packed together if 0.
+		 *
+		 *  Throws std::invalid_argument if rows overlap, or are not a whole
+		 *  number of pixels apart. */
+		void dismantle(u8* buffer, size_t width, size_t height, size_t stride = 0) const;
+
+		/** @brief Undoes dismantle(), with the same key and options.
+		 *
+		 *  Schemes 2 and 3 give back every image. Scheme 1 leaves many images
+		 *  an even number of pixels across changed. */
+		void remantle(u8* buffer, size_t width, size_t height, size_t stride = 0) const;
+
+	private:
+		struct state;
+		std::unique_ptr<state> _state;
+
+		void run(u8* buffer, size_t width, size_t height, size_t stride, bool undo) const;
+	};
+
+	/** @brief Dismantles an image with a context of its own, see context::dismantle(). */
+	void dismantle(u8* buffer, size_t width, size_t height, size_t stride, const std::string& key, const options& opts = options());
+
+	/** @brief Remantles an image with a context of its own, see context::remantle(). */
+	void remantle(u8* buffer, size_t width, size_t height, size_t stride, const std::string& key, const options& opts = options());
+}
+
+#endif // __LIBDISMANTLE_H__
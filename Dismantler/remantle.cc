@@ -1,124 +1,43 @@
-#include "fragment.hh"
+#include "batch.hh"
+#include "scramble.hh"
 #include <iostream>
 				
-void swap(fragment::pixel_block& block, size_t ox1, size_t oy1, size_t ox2, size_t oy2){ 
+/** Unscrambles only the tiles of `input` covering the region at (x, y), of
+ *  width x height, as tiled version `scheme` does, reading only the rows
+ *  they are in, and writes just the region out. Throws std::runtime_error
+ *  if the region is not in the image, the output is the input file itself,
+ *  or it cannot be written. */
+template <typename G1, typename G2>
+void crop(const fragment::key<G1>& key, const std::string& input, const std::string& output, size_t x, size_t y, size_t width, size_t height, size_t scheme){
+	effect::row_reader reader(input);
 	
-	fragment::pixel_block block1 = block.subblock(ox1, oy1);
-	fragment::pixel_block block2 = block.subblock(ox2, oy2);
+	if(effect::same_file(input, output))
+		throw std::runtime_error("Output file must not be the input file.");
 	
-	fragment::pixel_block tmp = {
-		0, 0,
-		block2.width, block2.height,
-		
-		block2.width, block2.height,
-		(effect::Pixel<u8>*) malloc(block2.width * block2.height * sizeof(effect::Pixel<u8>))
-	};
+	if(x >= reader.width() || y >= reader.height() || width == 0 || height == 0)
+		throw std::runtime_error("Crop is outside of the image.");
 	
-	fragment::pixel_block::copy(tmp,    block2);
-	fragment::pixel_block::copy(block2, block1);
-	fragment::pixel_block::copy(block1, tmp);
+	width  = std::min(width,  reader.width()  - x);
+	height = std::min(height, reader.height() - y);
 	
-	free(tmp.data);
-}
-
-template<typename Generator>
-void color_shift(fragment::pixel_block& block, size_t ox1, size_t oy1, size_t ox2, size_t oy2){
-	fragment::pixel_block block1 = block.subblock(ox1, oy1);
-	fragment::pixel_block block2 = block.subblock(ox2, oy2);
+	const size_t tx0 = x / fragment::tile_size, tx1 = (x + width  - 1) / fragment::tile_size + 1;
+	const size_t ty0 = y / fragment::tile_size, ty1 = (y + height - 1) / fragment::tile_size + 1;
 	
-	size_t width  = std::min(block1.width,  block2.width);
-	size_t height = std::min(block1.height, block2.height);
+	const size_t top    = ty0 * fragment::tile_size;
+	const size_t bottom = std::min(reader.height(), ty1 * fragment::tile_size);
 	
-	Generator rnd;
-	fragment::distribution color_dist(0x0, 0xFF);
-	fragment::distribution direction_dist(0, 1);
+	effect::Bitmap rows(reader.width(), bottom - top);
+	reader.seek(top);
+	reader.read(rows.data, rows.height);
 	
-	//printf("Applying color shift between subblocks (%zu, %zu) and (%zu, %zu) of block {%zu, %zu, %zu, %zu}\n", ox1, oy1, ox2, oy2, block.x, block.y, block.width, block.height);
+	scramble::apply_tiles<G1, G2>(key, rows, top, reader.height(), tx0, tx1, ty0, ty1, scheme, true);
 	
-	#pragma omp parallel for collapse(2)
-	for(size_t x = 0; x < width; ++x){
-		for(size_t y = 0; y < height; ++y){
-			size_t salt = (width * height) * ((x + 1) * (y + 1)) + ox1 - oy2 + oy1 + ox2;
-			
-			effect::Pixel<u8> shift;
-			
-			rnd.seed(salt);
-			size_t direction = direction_dist(rnd);
-			if(direction){
-				// Seed: Block2
-				// Dest: Block1
-				effect::Pixel<u8> *dest = block1.at(x, y);
-				#define s(c) \
-					rnd.seed(salt * (block2.at(x, y)->c ? block2.at(x, y)->c : 1)); \
-					dest->c -= color_dist(rnd);
-				
-				s(red);
-				s(green);
-				s(blue);
-				s(alpha);
-				
-				#undef s
-				
-			}else{
-				// Seed: Block1
-				// Dest: Block2
-				effect::Pixel<u8> *dest = block2.at(x, y);
-				#define s(c) \
-					rnd.seed(salt * (block1.at(x, y)->c ? block1.at(x, y)->c : 1)); \
-					dest->c -= color_dist(rnd);
-				
-				s(red);
-				s(green);
-				s(blue);
-				s(alpha);
-				
-				#undef s
-			}
-		}
-	}
-}
-
-template <typename G1, typename G2>
-void apply_effect(fragment::key<G1>& key, effect::Bitmap& source){
-	// Divide the image into multiple sizes of 2 x 2 blocks, and calculate
-	// the operations in that formatq
-	fragment::pixel_block block = {
-		0, 0, 
-		source.width, source.height, 
-		
-		source.width, source.height,
-		source.data
-	};
-	
-	std::vector<fragment::operation> operations = fragment::block_operations<G1>(key, block);
-	
-	// Run operations
-	for(s64 i = operations.size() - 1; i >= 0; --i){
-		fragment::operation op = operations[i];
-		for(s64 j = op.code.size() - 1; j >= 0; --j){
-			// Get current opcode
-			size_t mangled_opcode = op.code[j];
-			size_t opcode = op.opcode_table[mangled_opcode];
-			
-			switch(opcode){
-				// Position swap
-				case 0x0: swap(op.block, 0, 0, 1, 0); break; // Top-left    <=> Top-right
-				case 0x1: swap(op.block, 0, 1, 1, 1); break; // Bottom-left <=> Bottom-right
-				case 0x2: swap(op.block, 0, 0, 0, 1); break; // Top-left    <=> Bottom-left
-				case 0x3: swap(op.block, 1, 0, 1, 1); break; // Top-right   <=> Bottom-right
-				case 0x4: swap(op.block, 0, 0, 1, 1); break; // Top-left    <=> Bottom-right
-				case 0x5: swap(op.block, 0, 1, 1, 0); break; // Bottom-left <=> Top-right
-				
-				// Color shift
-				case 0x6: color_shift<G2>(op.block, 0, 0, 1, 0); break; // Top-left    <=> Top-right
-				case 0x7: color_shift<G2>(op.block, 0, 1, 1, 1); break; // Bottom-left <=> Bottom-right
-				case 0x8: color_shift<G2>(op.block, 0, 0, 0, 1); break; // Top-left    <=> Bottom-left
-				case 0x9: color_shift<G2>(op.block, 1, 0, 1, 1); break; // Top-right   <=> Bottom-right
-				case 0xA: color_shift<G2>(op.block, 0, 0, 1, 1); break; // Top-left    <=> Bottom-right
-				case 0xB: color_shift<G2>(op.block, 0, 1, 1, 0); break; // Bottom-left <=> Top-right
-			}
-		}
-	}
+	effect::BitmapView region = rows.region(x, y - top, width, height);
+	effect::row_writer writer(output, width, height);
+	for(size_t r = 0; r < height; ++r)
+		writer.write(region.row(r), 1);
+	
+	writer.close();
 }
 
 int main(int argc, char** argv){
@@ -127,9 +46,18 @@ int main(int argc, char** argv){
 		std::string key    = "";
 		std::string output = "";
 		
-		bool incomplete() { return source.empty() || key.empty() || output.empty(); }
+		bool incomplete() { return source.empty() || key.empty() || (output.empty() && !batch); }
 		
 		size_t complexity = 1;
+		size_t scheme     = fragment::default_scheme;
+		
+		std::string cache = ""; // Directory of the schedule cache
+		
+		bool   batch = false;
+		size_t jobs  = 0; // Images run at once, 0 for one per thread
+		
+		bool   cropped = false;
+		size_t crop[4] = { 0, 0, 0, 0 }; // X, Y, width and height
 	} flags;
 	
 	for(size_t i = 1; i < argc; ++i){
@@ -138,7 +66,21 @@ int main(int argc, char** argv){
 			flags.complexity = 0;
 		else if(std::string(argv[i]) == "--complex" || std::string(argv[i]) == "-c")
 			flags.complexity = 2;
-		else{
+		else if(std::string(argv[i]) == "--complexity" && i + 1 < argc)
+			flags.complexity = atoi(argv[++i]);
+		else if((std::string(argv[i]) == "--scheme" || std::string(argv[i]) == "-s") && i + 1 < argc)
+			flags.scheme = atoi(argv[++i]);
+		else if(std::string(argv[i]) == "--cache" && i + 1 < argc)
+			flags.cache = argv[++i];
+		else if(std::string(argv[i]) == "--batch" || std::string(argv[i]) == "-b")
+			flags.batch = true;
+		else if((std::string(argv[i]) == "--jobs" || std::string(argv[i]) == "-j") && i + 1 < argc)
+			flags.jobs = atoi(argv[++i]);
+		else if(std::string(argv[i]) == "--crop" && i + 4 < argc){
+			flags.cropped = true;
+			for(size_t c = 0; c < 4; ++c)
+				flags.crop[c] = atoi(argv[++i]);
+		}else{
 			// Parse default arguments
 			if(flags.source.empty())
 				flags.source = argv[i];
@@ -152,23 +94,55 @@ int main(int argc, char** argv){
 		}
 	}
 	
-	if(flags.incomplete()){
-		fprintf(stderr, "Usage: %s <Input> <Key> <Output>\n", argv[0]);
+	if(flags.incomplete() || flags.scheme < 1 || flags.scheme > fragment::scheme_version || flags.complexity > 3){
+		fprintf(stderr, "Usage: %s [--fast | --complex | --complexity <0-3>] [--scheme <1-%zu>] [--cache <Directory>] <Input> <Key> <Output>\n", argv[0], fragment::scheme_version);
+		fprintf(stderr, "       %s [...] --batch [--jobs <Images>] <Input directory> <Key> <Output directory>\n", argv[0]);
+		fprintf(stderr, "       %s [...] --batch [--jobs <Images>] <Manifest> <Key>\n", argv[0]);
+		fprintf(stderr, "       %s [...] --crop <X> <Y> <Width> <Height> <Input> <Key> <Output>\n", argv[0]);
 		return 3;
 	}
 	
-	#define run(g1, g2)\
-		glt::file source_image(flags.source.c_str()); \
+	if(flags.cropped && (flags.batch || !fragment::tiled(flags.scheme))){
+		fprintf(stderr, "Only single images of a tiled scheme can be cropped.\n");
+		return 3;
+	}
+	
+	// Every image is a job, all of them run with the same key
+	std::vector<batch::job> jobs;
+	try{
+		if(!flags.batch){
+			jobs.resize(1);
+			jobs[0].input  = flags.source;
+			jobs[0].output = flags.output;
+		}else if(batch::is_directory(flags.source)){
+			if(flags.output.empty()){
+				fprintf(stderr, "Batches of directories need an output directory.\n");
+				return 3;
+			}
+			
+			jobs = batch::directory(flags.source, flags.output);
+		}else
+			jobs = batch::manifest(flags.source);
+	}catch(const std::exception& e){
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+	
+	size_t failed = 0;
+	
+	#define run(g1, g2) \
 		fragment::key<g1> key(flags.key); \
 		\
-		effect::Bitmap source; \
-		source.width  = source_image.get_texture_header().width; \
-		source.height = source_image.get_texture_header().height; \
-		source.data   = (effect::Pixel<u8>*) source_image.get_texture_data(); \
-		\
-		apply_effect<g1, g2>(key, source); \
-		\
-		effect::write_bitmap(&source, flags.output)
+		if(flags.cropped){ \
+			try{ \
+				crop<g1, g2>(key, flags.source, flags.output, flags.crop[0], flags.crop[1], flags.crop[2], flags.crop[3], flags.scheme); \
+			}catch(const std::exception& e){ \
+				fprintf(stderr, "%s\n", e.what()); \
+				failed = 1; \
+			} \
+		}else \
+			failed = batch::run(jobs, key, flags.complexity, flags.scheme, flags.cache, flags.jobs, \
+				[&](const effect::BitmapView& image, const u8* opcodes){ scramble::apply_image<g1, g2>(key, image, opcodes, flags.scheme, true); })
 	
 	if(flags.complexity == 0){
 		run(fragment::light_random_generator, fragment::light_random_generator);
@@ -176,7 +150,11 @@ int main(int argc, char** argv){
 		run(fragment::heavy_random_generator, fragment::light_random_generator);
 	}else if(flags.complexity == 2){
 		run(fragment::heavy_random_generator, fragment::heavy_random_generator);
+	}else if(flags.complexity == 3){
+		run(fragment::secure_random_generator, fragment::secure_random_generator);
 	}
 	
 	#undef run
+	
+	return failed == 0 ? 0 : 1;
 }
@@ -0,0 +1,70 @@
+#include "libdismantle.hh"
+
+#include <cstdio>  // For fprintf()
+#include <cstdlib> // For atoi()
+#include <cstring> // For memcmp()
+#include <vector>  // For std::vector
+
+/** Checks that remantling undoes dismantling, bit for bit, over images of
+ *  sizes odd and even, below, at and above a tile, at every complexity.
+ *  Built like libdismantle, from roundtrip.cc, libdismantle.cc and
+ *  glt/glt.cc, with OpenMP. Prints every size that does not come back, and
+ *  exits with 1 if there were any. */
+int main(int argc, char** argv){
+	struct{
+		std::string key = "roundtrip";
+
+		size_t scheme = 0; // 0 for the latest
+	} flags;
+
+	for(size_t i = 1; i < argc; ++i){
+		// Parse flags
+		if((std::string(argv[i]) == "--scheme" || std::string(argv[i]) == "-s") && i + 1 < argc)
+			flags.scheme = atoi(argv[++i]);
+		else
+			flags.key = argv[i];
+	}
+
+	// Widths and heights, each checked both ways round
+	const size_t sizes[][2] = {
+		{   1,   1 }, {   2,   3 }, {  17,   9 }, {  64,  64 }, { 100,  37 }, { 255, 255 },
+		{ 256, 256 }, { 257, 257 }, { 300, 260 }, { 513, 256 }, { 640, 480 }
+	};
+
+	size_t failed = 0, checked = 0;
+	for(size_t complexity = 0; complexity <= 3; ++complexity){
+		dismantler::options opts;
+		opts.complexity = complexity;
+		opts.scheme     = flags.scheme;
+
+		dismantler::context context(flags.key, opts);
+
+		for(const auto& size : sizes){
+			for(size_t turn = 0; turn < (size[0] == size[1] ? 1 : 2); ++turn){
+				const size_t width  = size[turn];
+				const size_t height = size[1 - turn];
+
+				// Pixels that differ from one another, the same on every run
+				std::vector<u8> image(width * height * 4);
+				u64 state = width * 0x9E3779B97F4A7C15 + height;
+				for(size_t i = 0; i < image.size(); ++i){
+					state = state * 6364136223846793005 + 1442695040888963407;
+					image[i] = state >> 56;
+				}
+
+				std::vector<u8> pixels = image;
+				context.dismantle(pixels.data(), width, height);
+				context.remantle(pixels.data(), width, height);
+
+				++checked;
+				if(memcmp(pixels.data(), image.data(), image.size()) != 0){
+					fprintf(stderr, "%zux%zu at complexity %zu does not come back\n", width, height, complexity);
+					++failed;
+				}
+			}
+		}
+	}
+
+	printf("%zu of %zu images came back\n", checked - failed, checked);
+	return failed == 0 ? 0 : 1;
+}
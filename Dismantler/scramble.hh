@@ -0,0 +1,157 @@
+#ifndef __SCRAMBLE_H__
+#define __SCRAMBLE_H__
+
+#include "fragment.hh"
+
+#include <vector> // For std::vector
+
+/** Running schedules over images, either to dismantle them, or, with `undo`,
+ *  to remantle them, running every operation backwards, in the opposite
+ *  order. Shared by the dismantle and remantle tools and by libdismantle. */
+namespace scramble{
+	/** @brief Shifts the colours of one of the quarters at (ox1, oy1) and (ox2, oy2) by the other, as version 1 does.
+	 *
+	 *  Every thread reseeds a copy of `keyed`, a generator made from the key,
+	 *  so the shifts depend on it wherever the generator takes a key. */
+	template<typename Generator>
+	void color_shift(fragment::pixel_block& block, size_t ox1, size_t oy1, size_t ox2, size_t oy2, const Generator& keyed, bool undo){
+		fragment::pixel_block block1 = block.subblock(ox1, oy1);
+		fragment::pixel_block block2 = block.subblock(ox2, oy2);
+
+		size_t width  = std::min(block1.width,  block2.width);
+		size_t height = std::min(block1.height, block2.height);
+
+		// Every thread seeds its own generator, and quarters that overlap are
+		// shifted in order, so this is the same on any number of threads
+		#pragma omp parallel if(!fragment::pixel_block::overlap(block1, block2))
+		{
+			Generator rnd = keyed;
+			fragment::distribution color_dist(0x0, 0xFF);
+			fragment::distribution direction_dist(0, 1);
+
+			#pragma omp for collapse(2)
+			for(size_t x = 0; x < width; ++x){
+				for(size_t y = 0; y < height; ++y){
+					size_t salt = (width * height) * ((x + 1) * (y + 1)) + ox1 - oy2 + oy1 + ox2;
+
+					rnd.seed(salt);
+					size_t direction = direction_dist(rnd);
+
+					// Seeded by one quarter, shifting the other
+					fragment::pixel_block& source = direction ? block2 : block1;
+					effect::Pixel<u8>     *dest   = direction ? block1.at(x, y) : block2.at(x, y);
+
+					#define s(c) \
+						rnd.seed(salt * (source.at(x, y)->c ? source.at(x, y)->c : 1)); \
+						if(undo) \
+							dest->c -= color_dist(rnd); \
+						else \
+							dest->c += color_dist(rnd);
+
+					s(red);
+					s(green);
+					s(blue);
+					s(alpha);
+
+					#undef s
+				}
+			}
+		}
+	}
+
+	/** @brief Runs every operation of `schedule` over its pixels, as version `scheme` of the Dismantler does. */
+	template <typename G1, typename G2>
+	void apply_effect(const fragment::schedule<G1>& schedule, size_t scheme, bool undo){
+		const size_t levels   = schedule.levels().size();
+		const bool   disjoint = fragment::disjoint(scheme);
+
+		// Run operations level by level, a wave of them at a time, or all of
+		// it backwards to undo it. Their opcodes are worked out as they are
+		// run, unless they were derived ahead for a batch, or taken from the
+		// schedule cache.
+		for(size_t n = 0; n < levels; ++n){
+			const size_t           l  = undo ? levels - 1 - n : n;
+			const fragment::level& lv = schedule.levels()[l];
+
+			for(size_t m = 0; m < lv.waves(); ++m){
+				const size_t t = undo ? lv.waves() - 1 - m : m;
+				size_t begin = lv.wave_begin(t), end = lv.wave_end(t);
+
+				// Blocks of a wave never overlap
+				#pragma omp parallel if(end - begin > 1)
+				{
+					std::vector<u8> code;
+
+					#pragma omp for schedule(dynamic)
+					for(size_t i = begin; i < end; ++i){
+						fragment::operation op = schedule.at(l, i, lv.wave_row(t, i));
+						schedule.opcodes(op, code);
+
+						const u64 salt = schedule.salt(op);
+						auto swap = [&](u8 ox1, u8 oy1, u8 ox2, u8 oy2){
+							op.block.swap(ox1, oy1, ox2, oy2, disjoint);
+						};
+						auto shift = [&](u8 ox1, u8 oy1, u8 ox2, u8 oy2){
+							if(scheme == 1)
+								color_shift<G2>(op.block, ox1, oy1, ox2, oy2, schedule.template keyed<G2>(), undo);
+							else
+								op.block.shift(ox1, oy1, ox2, oy2, salt, undo, disjoint);
+						};
+
+						for(size_t k = 0; k < code.size(); ++k){
+							u8 opcode = code[undo ? code.size() - 1 - k : k];
+
+							switch(opcode){
+								// Position swap
+								case 0x0: swap(0, 0, 1, 0); break; // Top-left    <=> Top-right
+								case 0x1: swap(0, 1, 1, 1); break; // Bottom-left <=> Bottom-right
+								case 0x2: swap(0, 0, 0, 1); break; // Top-left    <=> Bottom-left
+								case 0x3: swap(1, 0, 1, 1); break; // Top-right   <=> Bottom-right
+								case 0x4: swap(0, 0, 1, 1); break; // Top-left    <=> Bottom-right
+								case 0x5: swap(0, 1, 1, 0); break; // Bottom-left <=> Top-right
+
+								// Color shift
+								case 0x6: shift(0, 0, 1, 0); break; // Top-left    <=> Top-right
+								case 0x7: shift(0, 1, 1, 1); break; // Bottom-left <=> Bottom-right
+								case 0x8: shift(0, 0, 0, 1); break; // Top-left    <=> Bottom-left
+								case 0x9: shift(1, 0, 1, 1); break; // Top-right   <=> Bottom-right
+								case 0xA: shift(0, 0, 1, 1); break; // Top-left    <=> Bottom-right
+								case 0xB: shift(0, 1, 1, 0); break; // Bottom-left <=> Top-right
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/** @brief Runs the tiles in columns [tx0, tx1) and rows [ty0, ty1) of an image `height` pixels tall, whose rows from `top` on are `rows`,
+	 *  as tiled version `scheme` of the Dismantler does. */
+	template <typename G1, typename G2>
+	void apply_tiles(const fragment::key<G1>& key, const effect::BitmapView& rows, size_t top, size_t height, size_t tx0, size_t tx1, size_t ty0, size_t ty1, size_t scheme, bool undo){
+		// Tiles are run on their own, a row of them at a time, each on a thread
+		for(size_t ty = ty0; ty < ty1; ++ty){
+			#pragma omp parallel for schedule(dynamic) if(tx1 - tx0 > 1)
+			for(size_t tx = tx0; tx < tx1; ++tx){
+				fragment::schedule<G1> schedule(key.tile(tx, ty), fragment::pixel_block::tile(rows, top, height, tx, ty));
+				apply_effect<G1, G2>(schedule, scheme, undo);
+			}
+		}
+	}
+
+	/** @brief Runs the whole of `image`, with the opcodes of its schedule, or NULL to derive them as it goes. */
+	template <typename G1, typename G2>
+	void apply_image(const fragment::key<G1>& key, const effect::BitmapView& image, const u8* opcodes, size_t scheme, bool undo){
+		if(fragment::tiled(scheme)){
+			apply_tiles<G1, G2>(key, image, 0, image.height, 0, fragment::tiles(image.width), 0, fragment::tiles(image.height), scheme, undo);
+			return;
+		}
+
+		fragment::schedule<G1> schedule(key, fragment::pixel_block::whole(image));
+		schedule.use(opcodes);
+
+		apply_effect<G1, G2>(schedule, scheme, undo);
+	}
+}
+
+#endif // __SCRAMBLE_H__
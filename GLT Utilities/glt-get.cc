@@ -1,6 +1,7 @@
 /** glt-get: Program to convert GLT files into PNG */
 
 #include <cstdio> // For C IO
+#include <vector> // For std::vector
 #include <Magick++.h> // For image decoding
 
 #include "glt/glt.hpp" // For everything GLT
@@ -17,14 +18,44 @@ int main(int argc, char** argv){
     // Open the image.
     glt::file file(argv[1]);
 
+    glt::texture_header header = file.get_texture_header();
+
+    // Unpack masks into a byte per pixel, black or white
+    std::vector<u8> unpacked;
+    if(header.format == GLT_PIXEL_FORMAT_R1){
+        const u8 *data = (const u8*) file.get_texture_data();
+
+        unpacked.resize(header.width * header.height);
+        for(size_t y = 0; y < header.height; ++y)
+            for(size_t x = 0; x < header.width; ++x)
+                unpacked[y * header.width + x] = (data[y * header.row_length() + x / 8] >> (x % 8)) & 1 ? 0xFF : 0x00;
+    }
+
     // Get a blob to it
-    Magick::Blob blob(file.get_texture_data(), file.get_texture_header().width * file.get_texture_header().height * 4);
+    Magick::Blob blob;
+    if(header.format == GLT_PIXEL_FORMAT_R1)
+        blob.update(unpacked.data(), unpacked.size());
+    else
+        blob.update(file.get_texture_data(), file.get_texture_data_length());
 
-    // Convert it using to PNG
+    // Convert it using to PNG, single channel formats as grayscale
     Magick::Image png;
-    png.size(std::to_string(file.get_texture_header().width) + "x" + std::to_string(file.get_texture_header().height));
-    png.depth(8);
-	png.magick("RGBA");
+    png.size(std::to_string(header.width) + "x" + std::to_string(header.height));
+    switch(header.format){
+        case GLT_PIXEL_FORMAT_R1:
+        case GLT_PIXEL_FORMAT_R8:
+            png.depth(8);
+            png.magick("GRAY");
+            break;
+        case GLT_PIXEL_FORMAT_R16:
+            png.depth(16);
+            png.endian(Magick::LSBEndian);
+            png.magick("GRAY");
+            break;
+        default:
+            png.depth(8);
+            png.magick("RGBA");
+    }
 	png.read(blob);
 	
 	png.magick("PNG");
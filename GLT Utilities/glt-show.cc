@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
+#include <vector>
 
 #include <GL/glew.h>
 #include <GL/gl.h>      // For everything GL, except window
@@ -29,7 +30,10 @@ int main(int argc, char **argv){
 
     // Print a warning if the file format is not known.
     if(file.get_texture_header().format != GLT_PIXEL_FORMAT_RGBA &&
-       file.get_texture_header().format != GLT_PIXEL_FORMAT_BGRA)
+       file.get_texture_header().format != GLT_PIXEL_FORMAT_BGRA &&
+       file.get_texture_header().format != GLT_PIXEL_FORMAT_R8   &&
+       file.get_texture_header().format != GLT_PIXEL_FORMAT_R16  &&
+       file.get_texture_header().format != GLT_PIXEL_FORMAT_R1)
         fprintf(stderr, "Warning: Unknown pixel format \'%d\'",
                         file.get_texture_header().format);
 
@@ -72,6 +76,24 @@ int main(int argc, char **argv){
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, nearest ? GL_NEAREST : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, nearest ? GL_NEAREST : GL_LINEAR);
 
+    // Single channel rows need not be 4-byte aligned.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Masks are unpacked into a byte per pixel, as red.
+    void *data = file.get_texture_data();
+
+    std::vector<u8> unpacked;
+    if(file.get_texture_header().format == GLT_PIXEL_FORMAT_R1){
+        glt::texture_header mask = file.get_texture_header();
+
+        unpacked.resize(mask.width * mask.height);
+        for(size_t y = 0; y < mask.height; ++y)
+            for(size_t x = 0; x < mask.width; ++x)
+                unpacked[y * mask.width + x] = (((u8*) data)[y * mask.row_length() + x / 8] >> (x % 8)) & 1 ? 0xFF : 0x00;
+
+        data = unpacked.data();
+    }
+
     glTexImage2D(GL_TEXTURE_2D,
                  0,
                  file.get_texture_header().gl_format(),
@@ -79,8 +101,8 @@ int main(int argc, char **argv){
                  file.get_texture_header().height,
                  0,
                  file.get_texture_header().gl_format(),
-                 GL_UNSIGNED_BYTE,
-                 file.get_texture_data());
+                 file.get_texture_header().gl_type(),
+                 data);
 
     // Texture width and height.
     glt::texture_header header = file.get_texture_header();
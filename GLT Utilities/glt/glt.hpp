@@ -25,6 +25,9 @@
  * pixel formats. */
 #define GLT_PIXEL_FORMAT_RGBA 0
 #define GLT_PIXEL_FORMAT_BGRA 1
+#define GLT_PIXEL_FORMAT_R8   2
+#define GLT_PIXEL_FORMAT_R16  3
+#define GLT_PIXEL_FORMAT_R1   4
 
 namespace glt{
     struct signature{
@@ -59,10 +62,52 @@ namespace glt{
                     return GL_RGBA;
                 case GLT_PIXEL_FORMAT_BGRA:
                     return GL_BGRA;
+                case GLT_PIXEL_FORMAT_R8:
+                case GLT_PIXEL_FORMAT_R16:
+                case GLT_PIXEL_FORMAT_R1:
+                    return GL_RED;
                 default:
                     return GL_RGBA;
             }
         }
+
+        // Returns the component type for OpenGL, R1 being unpacked into bytes first
+        u32 gl_type(){
+            switch(format){
+                case GLT_PIXEL_FORMAT_R16:
+                    return GL_UNSIGNED_SHORT;
+                default:
+                    return GL_UNSIGNED_BYTE;
+            }
+        }
+
+        // Returns the length of each pixel, in bytes, or of the bytes packed pixels share
+        size_t pixel_length(){
+            switch(format){
+                case GLT_PIXEL_FORMAT_RGBA:
+                    return 4 * sizeof(u8);
+                case GLT_PIXEL_FORMAT_BGRA:
+                    return 4 * sizeof(u8);
+                case GLT_PIXEL_FORMAT_R8:
+                    return 1 * sizeof(u8);
+                case GLT_PIXEL_FORMAT_R16:
+                    return 1 * sizeof(u16);
+                case GLT_PIXEL_FORMAT_R1:
+                    return 1 * sizeof(u8);
+                default:
+                    return 4 * sizeof(u8);
+            }
+        }
+
+        // Returns the length of each row, in bytes
+        size_t row_length(){
+            switch(format){
+                case GLT_PIXEL_FORMAT_R1:
+                    return (width + 7) / 8;
+                default:
+                    return width * pixel_length();
+            }
+        }
     };
 
     /** @brief Thrown if a parse error ocurred. */
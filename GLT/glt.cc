@@ -41,22 +41,10 @@ namespace glt{
          * Note: The GLT specification does not require overflow protection for
          *       this value, thus, none will be implemented here.
          */
-        this->_texture_data_length = _texture_header.width * _texture_header.height;
+        this->_texture_data_length = _texture_header.row_length() * _texture_header.height;
 
         // Determine the length of each pixel.
-        switch(_texture_header.format){
-            case GLT_PIXEL_FORMAT_RGBA:
-                this->_pixel_length = 4 * sizeof(u8);
-                break;
-            case GLT_PIXEL_FORMAT_BGRA:
-                this->_pixel_length = 4 * sizeof(u8);
-                break;
-            default:
-                this->_pixel_length = 4 * sizeof(u8);
-        }
-
-        // Multiply the number of pixels by the pixel length.
-        _texture_data_length *= _pixel_length;
+        this->_pixel_length = _texture_header.pixel_length();
 
         /* Allocate a buffer for the texture data and fill it with zeros,
          * then, read the remaining of the file (Corresponding to the